@@ -0,0 +1,206 @@
+/**
+ * @file ensemble.hpp
+ * @brief 2重振り子の初期条件の格子をSIMDでまとめて積分し，ひっくり返るまでの時間を求める
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>    // min,max
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief SIMDのレーン数
+ * @details -march=nativeでビルドすればAVX-512なら8，AVXなら4，それ以外はSSE2の2．
+ */
+#if defined(__AVX512F__)
+constexpr int simd_width = 8;
+#elif defined(__AVX__)
+constexpr int simd_width = 4;
+#else
+constexpr int simd_width = 2;
+#endif
+
+/**
+ * @brief simd_width個のdoubleとint64(GCCのベクトル拡張)
+ * @details 四則演算と比較はレーンごとに計算される．比較の結果はint64のマスク(真が-1)．
+ */
+using vdouble = double __attribute__((vector_size(8*simd_width)));
+using vint64 = std::int64_t __attribute__((vector_size(8*simd_width)));
+
+inline vdouble vbroadcast(const double x){
+    return vdouble{} + x;
+}
+
+/**
+ * @brief レーンごとのsinとcos
+ * @details xをπ/2の倍数nと余りr(|r| <= π/4)に分け(π/2は3つの部分に分けて引く)，
+ *          rのsinとcosをCephesの多項式で求めてnの下2ビットで入れ替えと符号を決める．|x| < 2^20程度まで倍精度の精度が出る．
+ */
+inline void vsincos(const vdouble x, vdouble &s, vdouble &c){
+    const vdouble magic = vbroadcast(6755399441055744.);    // 1.5*2^52を足して引くと最も近い整数に丸まる
+    const vdouble n = (x*0.63661977236758134308 + magic) - magic;
+    const vdouble r = ((x - n*1.57079632673412561417e+00) - n*6.07710050630396597660e-11) - n*2.02226624879595063154e-21;
+    const vdouble z = r*r;
+    const vdouble sr = r + r*z*((((((1.58962301576546568060e-10*z - 2.50507477628578072866e-8)*z + 2.75573136213857245213e-6)*z
+                                  - 1.98412698295895385996e-4)*z + 8.33333333332211858878e-3)*z) - 1.66666666666666307295e-1);
+    const vdouble cr = 1. - 0.5*z + z*z*(((((-1.13585365213876817300e-11*z + 2.08757008419747316778e-9)*z - 2.75573141792967388112e-7)*z
+                                          + 2.48015872888517045348e-5)*z - 1.38888888888730564116e-3)*z + 4.16666666666665929218e-2);
+    const vint64 q = __builtin_convertvector(n, vint64);
+    const vint64 swap = (q & 1) != 0;
+    const vint64 neg_s = (q & 2) != 0;
+    const vint64 neg_c = ((q + 1) & 2) != 0;
+    const vdouble s0 = swap ? cr : sr;
+    const vdouble c0 = swap ? sr : cr;
+    s = neg_s ? -s0 : s0;
+    c = neg_c ? -c0 : c0;
+}
+
+/**
+ * @brief 2重振り子のパラメータ
+ */
+struct PendulumParameters{
+    double m1, m2, l1, l2, g;
+};
+
+/**
+ * @brief 格子の設定
+ * @details 格子の(i, j)はθ1 = -π + (j + 1/2)2π/size，θ2 = π - (i + 1/2)2π/sizeで，静止した状態から始める．
+ *          どちらかの振り子が真上を越えた(|θ| > π)時刻をひっくり返った時刻とする．
+ */
+struct FlipMapConfig{
+    int size = 1024;
+    double tmax = 10.;
+    double dt = 0.01;
+    int threads = 0;        // 0ならハードウェアのスレッド数
+    std::string output = "flip.pgm";
+};
+
+/**
+ * @brief simd_width本の振り子をRK4で同時に進めるときの右辺
+ */
+inline void ensemble_derivative(const PendulumParameters &p, const vdouble t1, const vdouble t2, const vdouble w1, const vdouble w2,
+                                vdouble &a1, vdouble &a2){
+    vdouble s1, c1, s2, c2;
+    vsincos(t1, s1, c1);
+    vsincos(t2, s2, c2);
+    const vdouble sd = s1*c2 - c1*s2;   // sin(θ1 - θ2)
+    const vdouble cd = c1*c2 + s1*s2;   // cos(θ1 - θ2)
+    const vdouble den = p.m1 + p.m2*sd*sd;
+    const vdouble w1sq = w1*w1, w2sq = w2*w2;
+    a1 = (-p.m1*p.g*s1 - p.m2*(p.g*s1 + p.l2*w2sq*sd + (p.l1*w1sq*sd - p.g*s2)*cd))/(p.l1*den);
+    a2 = ((p.m1 + p.m2)*(p.l1*w1sq*sd - p.g*s2 + p.g*s1*cd) + p.m2*p.l2*w2sq*cd*sd)/(p.l2*den);
+}
+
+/**
+ * @brief simd_width本の振り子を一斉に進め，ひっくり返った時刻を求める
+ * @param[in] p パラメータ, theta1, theta2 初期角度(simd_width個), tmax 打ち切り時刻, dt 刻み幅
+ * @param[out] flip ひっくり返った時刻，tmaxまでにひっくり返らなければ-1
+ * @details レーンごとに最初にひっくり返った時刻だけを記録し，全レーンがひっくり返ったらそこでやめる．
+ */
+inline void ensemble_flip_times(const PendulumParameters &p, const double *theta1, const double *theta2,
+                                const double tmax, const double dt, double *flip){
+    vdouble t1, t2, w1 = vbroadcast(0.), w2 = vbroadcast(0.), time = vbroadcast(-1.);
+    for(int k = 0; k < simd_width; k++){
+        t1[k] = theta1[k];
+        t2[k] = theta2[k];
+    }
+    const double pi2 = M_PI*M_PI;
+    const double half = dt/2., sixth = dt/6.;
+    vint64 done = vint64{};
+    const long long steps = std::llround(tmax/dt);
+    for(long long i = 1; i <= steps; i++){
+        vdouble a1k1, a2k1, a1k2, a2k2, a1k3, a2k3, a1k4, a2k4;
+        ensemble_derivative(p, t1, t2, w1, w2, a1k1, a2k1);
+        const vdouble t1k2 = t1 + half*w1, t2k2 = t2 + half*w2, w1k2 = w1 + half*a1k1, w2k2 = w2 + half*a2k1;
+        ensemble_derivative(p, t1k2, t2k2, w1k2, w2k2, a1k2, a2k2);
+        const vdouble t1k3 = t1 + half*w1k2, t2k3 = t2 + half*w2k2, w1k3 = w1 + half*a1k2, w2k3 = w2 + half*a2k2;
+        ensemble_derivative(p, t1k3, t2k3, w1k3, w2k3, a1k3, a2k3);
+        const vdouble t1k4 = t1 + dt*w1k3, t2k4 = t2 + dt*w2k3, w1k4 = w1 + dt*a1k3, w2k4 = w2 + dt*a2k3;
+        ensemble_derivative(p, t1k4, t2k4, w1k4, w2k4, a1k4, a2k4);
+        t1 += sixth*(w1 + 2.*w1k2 + 2.*w1k3 + w1k4);
+        t2 += sixth*(w2 + 2.*w2k2 + 2.*w2k3 + w2k4);
+        w1 += sixth*(a1k1 + 2.*a1k2 + 2.*a1k3 + a1k4);
+        w2 += sixth*(a2k1 + 2.*a2k2 + 2.*a2k3 + a2k4);
+        // 今のステップで初めてひっくり返ったレーン
+        const vint64 flipped = (t1*t1 > pi2) | (t2*t2 > pi2);
+        const vint64 now = flipped & ~done;
+        time = now ? vbroadcast(i*dt) : time;
+        done |= flipped;
+        bool all = true;
+        for(int k = 0; k < simd_width; k++) all = all && done[k];
+        if(all) break;
+    }
+    for(int k = 0; k < simd_width; k++) flip[k] = time[k];
+}
+
+/**
+ * @brief 格子のすべての初期条件についてひっくり返った時刻を求める
+ * @param[in] p パラメータ, config 格子の設定
+ * @param[out] std::vector<float> 行優先でsize*size個の時刻，ひっくり返らなければ-1
+ * @details 静止した状態からのエネルギーがどちらかの振り子を真上に持ち上げるのに足りない初期条件は，積分せずに-1とする．
+ *          残った初期条件を1行ずつsimd_width個ずつにまとめて積分する．行はスレッドが順に取っていく．
+ */
+inline std::vector<float> flip_map(const PendulumParameters &p, const FlipMapConfig &config){
+    const int n = config.size;
+    std::vector<float> result(static_cast<std::size_t>(n)*n, -1.f);
+    // 真上を越えるのに必要な位置エネルギーの最小値
+    const double barrier = -std::abs((p.m1 + p.m2)*p.l1 - p.m2*p.l2)*p.g;
+    const double step = 2.*M_PI/n;
+    std::atomic<int> next_row(0);
+    auto work = [&](){
+        std::vector<int> columns;
+        double theta1[simd_width], theta2[simd_width], flip[simd_width];
+        for(int i = next_row.fetch_add(1); i < n; i = next_row.fetch_add(1)){
+            const double t2 = M_PI - (i + 0.5)*step;
+            columns.clear();
+            for(int j = 0; j < n; j++){
+                const double t1 = -M_PI + (j + 0.5)*step;
+                const double energy = -(p.m1 + p.m2)*p.g*p.l1*std::cos(t1) - p.m2*p.g*p.l2*std::cos(t2);
+                if(energy >= barrier) columns.push_back(j);
+            }
+            for(std::size_t k = 0; k < columns.size(); k += simd_width){
+                // 端数のレーンは最後の初期条件で埋める
+                for(int lane = 0; lane < simd_width; lane++){
+                    const int j = columns[std::min(k + lane, columns.size() - 1)];
+                    theta1[lane] = -M_PI + (j + 0.5)*step;
+                    theta2[lane] = t2;
+                }
+                ensemble_flip_times(p, theta1, theta2, config.tmax, config.dt, flip);
+                for(int lane = 0; lane < simd_width && k + lane < columns.size(); lane++){
+                    result[static_cast<std::size_t>(i)*n + columns[k + lane]] = static_cast<float>(flip[lane]);
+                }
+            }
+        }
+    };
+    const int n_threads = config.threads > 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for(int t = 1; t < n_threads; t++) threads.emplace_back(work);
+    work();
+    for(auto&& t : threads) t.join();
+    return result;
+}
+
+/**
+ * @brief ひっくり返った時刻を8ビットのグレースケール画像(PGM)に書く
+ * @details 早くひっくり返ったほど明るく，log(1 + t)/log(1 + tmax)で明るさを下げる．ひっくり返らなければ黒．
+ */
+inline bool write_flip_image(const std::string &filename, const std::vector<float> &flip, const int size, const double tmax){
+    std::ofstream file(filename, std::ios::binary);
+    if(!file) return false;
+    file << "P5\n" << size << " " << size << "\n255\n";
+    std::vector<unsigned char> pixels(flip.size());
+    const double scale = std::log1p(tmax);
+    for(std::size_t k = 0; k < flip.size(); k++){
+        if(flip[k] < 0.f) pixels[k] = 0;
+        else pixels[k] = static_cast<unsigned char>(std::lround(32. + 223.*(1. - std::log1p(flip[k])/scale)));
+    }
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    return file.good();
+}
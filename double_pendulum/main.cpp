@@ -1,14 +1,28 @@
 /*
 2重振り子
-RK4
+RK4，陰的中点法，Störmer-Verlet法，Yoshida法(4次，6次)
+./a.out --method verlet --dt 0.05 で積分法と刻み幅を選ぶ(デフォルトはrk4と0.01)
+methodはrk4, midpoint, verlet, yoshida4, yoshida6
+./a.out --report でそれぞれの積分法と刻み幅についてtlimまで進め，エネルギーのずれの最大値，右辺の評価回数，時間を表示する
+シンプレクティックな積分法は角度と正準運動量で進める
+./a.out --flip-map 1024 --tmax 10 --threads 8 --output flip.pgm で静止した状態から始めた(θ1, θ2)の1024x1024の格子について
+ひっくり返るまでの時間をSIMDと全コアで求め，画像に書く(ensemble.hpp，刻み幅は--dt)
+g++ -O3 -march=native -pthread -I/usr/include/eigen3 main.cpp でビルドするとAVX2/AVX-512を使う
 */
 
 #include<iostream>
 #include<cmath>
 #include<fstream>
+#include<string>
+#include<chrono>
+#include<algorithm>
 
 #include<Eigen/Core>
 
+#include "../ode/rk4.hpp"
+#include "../ode/symplectic.hpp"
+#include "ensemble.hpp"
+
 // 重力加速度
 constexpr double g = 9.80665;
 
@@ -25,25 +39,32 @@ constexpr double l2 = 1.;
 using std::sin;
 using std::cos;
 
+// 一般化座標(角度)と正準運動量
+using Coord = Eigen::Matrix<double, 2, 1>;
+
+// 右辺の評価回数(--reportで使う)
+// updateConditionは2，angularVelocityとgeneralizedForceは1ずつ数える
+long long evaluations = 0;
+
 // 運動方程式
-Eigen::Matrix<double, 4, 1> updateCondition(const Eigen::Matrix<double, 4, 1> x){
+void updateCondition(const Eigen::Matrix<double, 4, 1> &x, Eigen::Matrix<double, 4, 1> &dxdt, const double /*t*/){
+    evaluations += 2;
     double theta1 = x(0,0);
     double theta2 = x(1,0);
     double dtheta1 = x(2,0);
     double dtheta2 = x(3,0);
 
-    return Eigen::Matrix<double, 4, 1>{
+    dxdt <<
         dtheta1,
         dtheta2,
         (-m1*g*sin(theta1) - m2*(g*sin(theta1) + l2*dtheta2*dtheta2*sin(theta1 - theta2) + (l1*dtheta1*dtheta1*sin(theta1 - theta2) - g*sin(theta2))*cos(theta1 - theta2)))/(l1*(m1 + m2*sin(theta1 - theta2)*sin(theta1 - theta2))),
-        ((m1 + m2)*(l1*dtheta1*dtheta1*sin(theta1 - theta2) - g*sin(theta2) + g*sin(theta1)*cos(theta1-theta2)) + m2*l2*dtheta2*dtheta2*cos(theta1 - theta2)*sin(theta1 - theta2))/(l2*(m1 + m2*sin(theta1 - theta2)*sin(theta1 - theta2)))
-    };
+        ((m1 + m2)*(l1*dtheta1*dtheta1*sin(theta1 - theta2) - g*sin(theta2) + g*sin(theta1)*cos(theta1-theta2)) + m2*l2*dtheta2*dtheta2*cos(theta1 - theta2)*sin(theta1 - theta2))/(l2*(m1 + m2*sin(theta1 - theta2)*sin(theta1 - theta2)));
 }
 
 double potentialEnergy(const Eigen::Matrix<double, 4, 1> x){
     double theta1 = x(0,0);
     double theta2 = x(1,0);
-    return -m1*g*cos(theta1) - m2*g*(l1*cos(theta1) + l2*cos(theta2));
+    return -m1*g*l1*cos(theta1) - m2*g*(l1*cos(theta1) + l2*cos(theta2));
 }
 
 double kineticEnergy(const Eigen::Matrix<double, 4, 1> x){
@@ -55,6 +76,104 @@ double kineticEnergy(const Eigen::Matrix<double, 4, 1> x){
     return 0.5*m1*l1*l1*dtheta1*dtheta1 + 0.5*m2*(l1*l1*dtheta1*dtheta1 + l2*l2*dtheta2*dtheta2 + 2*l1*l2*dtheta1*dtheta2*cos(theta1 - theta2));
 }
 
+// ハミルトニアン H = 1/2 p^T M(θ)^-1 p + V(θ)
+// M = [[(m1 + m2)l1^2, m2 l1 l2 cos(θ1 - θ2)], [m2 l1 l2 cos(θ1 - θ2), m2 l2^2]]
+
+// 角速度から正準運動量 p = M dθ
+Coord momentum(const Eigen::Matrix<double, 4, 1> &x){
+    double c = cos(x(0,0) - x(1,0));
+    return Coord{
+        (m1 + m2)*l1*l1*x(2,0) + m2*l1*l2*c*x(3,0),
+        m2*l2*l2*x(3,0) + m2*l1*l2*c*x(2,0)
+    };
+}
+
+// dθ/dt = ∂H/∂p = M^-1 p
+void angularVelocity(const Coord &q, const Coord &p, Coord &dq){
+    evaluations += 1;
+    double s = sin(q(0,0) - q(1,0));
+    double c = cos(q(0,0) - q(1,0));
+    double d = m1 + m2*s*s;
+    dq <<
+        (l2*p(0,0) - l1*c*p(1,0))/(l1*l1*l2*d),
+        (l1*(m1 + m2)*p(1,0) - l2*m2*c*p(0,0))/(l1*l2*l2*m2*d);
+}
+
+// dp/dt = -∂H/∂θ
+void generalizedForce(const Coord &q, const Coord &p, Coord &dp){
+    evaluations += 1;
+    double s = sin(q(0,0) - q(1,0));
+    double c = cos(q(0,0) - q(1,0));
+    double d = m1 + m2*s*s;
+    double C1 = p(0,0)*p(1,0)*s/(l1*l2*d);
+    double C2 = (l2*l2*m2*p(0,0)*p(0,0) + l1*l1*(m1 + m2)*p(1,0)*p(1,0) - 2.*l1*l2*m2*c*p(0,0)*p(1,0))*s*c/(l1*l1*l2*l2*d*d);
+    dp <<
+        -(m1 + m2)*g*l1*sin(q(0,0)) - C1 + C2,
+        -m2*g*l2*sin(q(1,0)) + C1 - C2;
+}
+
+// 積分法
+enum class Method{ rk4, midpoint, verlet, yoshida4, yoshida6 };
+
+const char *methodName(const Method method){
+    switch(method){
+        case Method::rk4: return "rk4";
+        case Method::midpoint: return "midpoint";
+        case Method::verlet: return "verlet";
+        case Method::yoshida4: return "yoshida4";
+        case Method::yoshida6: return "yoshida6";
+    }
+    return "";
+}
+
+bool methodFromName(const std::string &name, Method &method){
+    for(Method m : {Method::rk4, Method::midpoint, Method::verlet, Method::yoshida4, Method::yoshida6}){
+        if(name == methodName(m)){
+            method = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 選んだ積分法で(θ1, θ2, dθ1, dθ2)を進める
+// シンプレクティックな積分法は正準運動量に直して進め，角速度に戻す
+class Integrator
+{
+private:
+    Method method;
+    ode::RK4<Eigen::Matrix<double, 4, 1> > rk4;
+    ode::ImplicitMidpoint<Coord> midpoint;
+    ode::StormerVerlet<Coord> verlet;
+    ode::Yoshida<Coord, 4> yoshida4;
+    ode::Yoshida<Coord, 6> yoshida6;
+public:
+    explicit Integrator(const Method method) : method(method) {}
+    // 陰的な式が解けなかったらfalseを返し，xを変えない
+    bool step(Eigen::Matrix<double, 4, 1> &x, const double t, const double h){
+        if(method == Method::rk4){
+            rk4.step(updateCondition, x, t, h);
+            return x.allFinite();
+        }
+        Coord q = x.head<2>();
+        Coord p = momentum(x);
+        bool ok = false;
+        switch(method){
+            case Method::midpoint: ok = midpoint.step(angularVelocity, generalizedForce, q, p, h); break;
+            case Method::verlet: ok = verlet.step(angularVelocity, generalizedForce, q, p, h); break;
+            case Method::yoshida4: ok = yoshida4.step(angularVelocity, generalizedForce, q, p, h); break;
+            case Method::yoshida6: ok = yoshida6.step(angularVelocity, generalizedForce, q, p, h); break;
+            default: break;
+        }
+        if(!ok) return false;
+        Coord dq;
+        angularVelocity(q, p, dq);
+        evaluations -= 1;   // 角速度に戻すのは数えない
+        x << q, dq;
+        return true;
+    }
+};
+
 Eigen::Matrix<double, 4, 1> initialCondition(){
     double theta1 = 4.*std::atan(1.) * 2. / 2.;
     double theta2 = 4.*std::atan(1.) * 0. / 2.;
@@ -69,11 +188,89 @@ Eigen::Matrix<double, 4, 1> initialCondition(){
     };
 }
 
-int main()
+
+// 積分法と刻み幅ごとにtlimまで進め，エネルギーのずれと計算量を表示する
+void report(){
+    const double steps[] = {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1};
+    std::printf("%-9s %6s %12s %12s %12s %9s\n", "method", "dt", "max|dE|", "final|dE|", "rhs", "sec");
+    for(Method method : {Method::rk4, Method::midpoint, Method::verlet, Method::yoshida4, Method::yoshida6}){
+        for(double h : steps){
+            Integrator integrator(method);
+            Eigen::Matrix<double, 4, 1> x = initialCondition();
+            const double E0 = kineticEnergy(x) + potentialEnergy(x);
+            double drift = 0., dE = 0.;
+            evaluations = 0;
+            const auto start = std::chrono::steady_clock::now();
+            const long long n = std::llround(tlim/h);
+            long long i = 0;
+            for(; i < n; i++){
+                if(!integrator.step(x, i*h, h)) break;
+                dE = std::abs(kineticEnergy(x) + potentialEnergy(x) - E0);
+                drift = std::max(drift, dE);
+            }
+            const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(i < n){
+                std::printf("%-9s %6.3f failed at t = %g (implicit stage did not converge)\n", methodName(method), h, i*h);
+                continue;
+            }
+            std::printf("%-9s %6.3f %12.3e %12.3e %12lld %9.4f\n", methodName(method), h, drift, dE, evaluations/2, sec);
+        }
+    }
+}
+
+// 初期条件の格子についてひっくり返るまでの時間を求めて画像に書く
+int flipMap(const FlipMapConfig &config){
+    const PendulumParameters parameters{m1, m2, l1, l2, g};
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<float> flip = flip_map(parameters, config);
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const long long flipped = std::count_if(flip.begin(), flip.end(), [](const float t){ return t >= 0.f; });
+    std::printf("%dx%d pendulums (simd width %d): %lld flipped within %g, %.2f sec, %.3g pendulums/sec\n",
+                config.size, config.size, simd_width, flipped, config.tmax, sec, flip.size()/sec);
+    if(!write_flip_image(config.output, flip, config.size, config.tmax)){
+        std::cerr << "cannot write " << config.output << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
+    Method method = Method::rk4;
+    double h = dt;
+    FlipMapConfig flip_config;
+    bool flip_map_mode = false;
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if(arg == "--report"){
+            report();
+            return 0;
+        }
+        else if(arg == "--method" && i + 1 < argc){
+            if(!methodFromName(argv[++i], method)){
+                std::cerr << "unknown method " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "--dt" && i + 1 < argc) h = std::stod(argv[++i]);
+        else if(arg == "--flip-map" && i + 1 < argc){
+            flip_map_mode = true;
+            flip_config.size = std::stoi(argv[++i]);
+        }
+        else if(arg == "--tmax" && i + 1 < argc) flip_config.tmax = std::stod(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc) flip_config.threads = std::stoi(argv[++i]);
+        else if(arg == "--output" && i + 1 < argc) flip_config.output = argv[++i];
+    }
+    if(flip_map_mode){
+        flip_config.dt = h;
+        return flipMap(flip_config);
+    }
+
     Eigen::Matrix<double, 4, 1> x = initialCondition();
-    Eigen::Matrix<double, 4, 1> k1, k2, k3, k4;
+    Integrator integrator(method);
     double t = 0., KE, PE;
+    // gifは0.1ごとに1コマ
+    const std::size_t frame = std::max(1L, std::lround(0.1/h));
 
     std::fstream data;
     data.open("data.csv", std::ios::out);
@@ -89,9 +286,9 @@ int main()
     for(std::size_t i {}; t < tlim; ++i){
         KE = kineticEnergy(x);
         PE = potentialEnergy(x);
-        std::cout << i*dt << " " << KE + PE << std::endl; // エネルギーが保存されているか確認
+        std::cout << i*h << " " << KE + PE << std::endl; // エネルギーが保存されているか確認
 
-        if (i%10==0){
+        if (i%frame==0){
             // gnuplot
             fprintf(gp, "plot '-' w lp lw 3\n");
             fprintf(gp, "0.0 0.0\n");
@@ -103,14 +300,11 @@ int main()
         // csv
         data << x(0,0) << "," << x(1,0) << "," << x(2,0) << "," << x(3,0) << std::endl;
 
-        // RK4
-        k1 = updateCondition(x);
-        k2 = updateCondition(x + dt/2*k1);
-        k3 = updateCondition(x + dt/2*k2);
-        k4 = updateCondition(x + dt*k3);
-
-        x += dt/6*(k1 + 2*k2 + 2*k3 + k4);
-        t += dt;
+        if(!integrator.step(x, t, h)){
+            std::cerr << "step failed at t = " << t << " (implicit stage did not converge), try a smaller --dt" << std::endl;
+            break;
+        }
+        t += h;
     }
     // fprintf(gp, "set out\n");
     // fprintf(gp, "set terminal wxt enhanced\n");
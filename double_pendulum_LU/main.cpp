@@ -1,95 +1,164 @@
 /*
 2重振り子
-LU分解で連立方程式を解く
+連立方程式を解いて角加速度を求める(2x2は閉じた式，それ以外はLU分解)
 RK4
+数の型はテンプレート引数で，./a.out --scalar qd のように実行時に選ぶ(デフォルトはdec100)
+double    : double(53ビット)
+dd        : double-double(106ビット，multi_double.hpp)
+qd        : quad-double(212ビット，multi_double.hpp)
+float128  : __float128(113ビット，boost::multiprecision::float128，-lquadmathでリンクする)
+bin50     : boost::multiprecision::cpp_bin_float_50(10進50桁)
+bin100    : boost::multiprecision::cpp_bin_float_100(10進100桁)
+dec100    : boost::multiprecision::cpp_dec_float_100(10進100桁)
+mpfr100   : boost::multiprecision::mpfr_float_100(MPFRがあるときだけ，-lmpfr -lgmpでリンクする)
+./a.out --compare 1 でそれぞれの型で時刻1まで進め，1ステップの時間とdec100との差を表示する
 */
 
 #include<iostream>
 #include<cmath>
 #include<fstream>
+#include<string>
+#include<chrono>
 
 #include<boost/multiprecision/cpp_dec_float.hpp>
+#include<boost/multiprecision/cpp_bin_float.hpp>
+#ifdef __SIZEOF_FLOAT128__
+#include<boost/multiprecision/float128.hpp>
+#endif
+#if __has_include(<mpfr.h>)
+#define USE_MPFR
+#include<boost/multiprecision/mpfr.hpp>
+#endif
+#include<boost/math/constants/constants.hpp>
 #include<Eigen/Core>
 #include<Eigen/LU>
 
+#include "../ode/rk4.hpp"
+#include "multi_double.hpp"
+
 namespace mp = boost::multiprecision;
-using multiFloat = mp::cpp_dec_float_100;
 
 using std::sin;
 using std::cos;
 
-// 重力加速度
-const multiFloat g = 9.80665;
-
-// 時間パラメータ
-const multiFloat tlim = 100.;
-const multiFloat dt = 0.01;
-
-// 振り子のパラメータ
-const multiFloat m1 = 5.;
-const multiFloat m2 = 2.;
-const multiFloat l1 = 0.5;
-const multiFloat l2 = 1.;
-
-// 運動方程式
-Eigen::Matrix<multiFloat, 4, 1> updateCondition(const Eigen::Matrix<multiFloat, 4, 1> condition){
-    multiFloat theta1 = condition(0,0);
-    multiFloat theta2 = condition(1,0);
-    multiFloat dtheta1 = condition(2,0);
-    multiFloat dtheta2 = condition(3,0);
-
-    Eigen::Matrix<multiFloat, 2, 2> A;
-    A << (m1 + m2)*l1, m2*l2*cos(theta1 - theta2),
-         l1*l2*cos(theta1 - theta2), l2*l2;
-    Eigen::Matrix<multiFloat, 2, 1> b;
-    b << -m2*l2*dtheta2*dtheta2*sin(theta1 - theta2) - (m1 + m2)*g*sin(theta1),
-         l1*l2*dtheta1*dtheta1*sin(theta1 - theta2) - g*l2*sin(theta2);
-    Eigen::FullPivLU<Eigen::Matrix<multiFloat, 2, 2> > LU(A);
-    Eigen::Matrix<multiFloat, 2, 1> x;
-    x = LU.solve(b);
-
-    return Eigen::Matrix<multiFloat, 4, 1>{
-        dtheta1,
-        dtheta2,
-        x(0),
-        x(1)
-    };
+// 円周率
+template<class Scalar>
+Scalar pi(){
+    return boost::math::constants::pi<Scalar>();
 }
 
-Eigen::Matrix<multiFloat, 4, 1> initialCondition(){
-    multiFloat theta1 = 4.*std::atan(1.) * 2. / 2.;
-    multiFloat theta2 = 4.*std::atan(1.) * 0. / 2.;
-    multiFloat dtheta1 = 0.;
-    multiFloat dtheta2 = 0.001;
-
-    return Eigen::Matrix<multiFloat, 4, 1>{
-        theta1,
-        theta2,
-        dtheta1,
-        dtheta2
-    };
+template<>
+DoubleDouble pi<DoubleDouble>(){
+    return DoubleDouble::pi();
 }
 
-multiFloat potentialEnergy(const Eigen::Matrix<multiFloat, 4, 1> x){
-    multiFloat theta1 = x(0,0);
-    multiFloat theta2 = x(1,0);
-    return -m1*g*cos(theta1) - m2*g*(l1*cos(theta1) + l2*cos(theta2));
+template<>
+QuadDouble pi<QuadDouble>(){
+    return QuadDouble::pi();
 }
 
-multiFloat kineticEnergy(const Eigen::Matrix<multiFloat, 4, 1> x){
-    multiFloat theta1 = x(0,0);
-    multiFloat theta2 = x(1,0);
-    multiFloat dtheta1 = x(2,0);
-    multiFloat dtheta2 = x(3,0);
+// 連立方程式 A x = b
+// 一般の大きさはLU分解で解く
+template<class Scalar, int Size>
+struct LinearSolver
+{
+    static Eigen::Matrix<Scalar, Size, 1> solve(const Eigen::Matrix<Scalar, Size, Size> &A, const Eigen::Matrix<Scalar, Size, 1> &b){
+        Eigen::FullPivLU<Eigen::Matrix<Scalar, Size, Size> > LU(A);
+        return LU.solve(b);
+    }
+};
 
-    return 0.5*m1*l1*l1*dtheta1*dtheta1 + 0.5*m2*(l1*l1*dtheta1*dtheta1 + l2*l2*dtheta2*dtheta2 + 2*l1*l2*dtheta1*dtheta2*cos(theta1 - theta2));
-}
+// 2x2はクラメルの公式で解く
+template<class Scalar>
+struct LinearSolver<Scalar, 2>
+{
+    static Eigen::Matrix<Scalar, 2, 1> solve(const Eigen::Matrix<Scalar, 2, 2> &A, const Eigen::Matrix<Scalar, 2, 1> &b){
+        const Scalar det = A(0,0)*A(1,1) - A(0,1)*A(1,0);
+        return Eigen::Matrix<Scalar, 2, 1>{
+            Scalar((A(1,1)*b(0) - A(0,1)*b(1))/det),
+            Scalar((A(0,0)*b(1) - A(1,0)*b(0))/det)
+        };
+    }
+};
 
-int main()
+// 2重振り子
+// パラメータは整数の比で与えるので，どの型でもその型の精度で正確になる
+template<class Scalar>
+struct DoublePendulum
 {
-    Eigen::Matrix<multiFloat, 4, 1> x = initialCondition();
-    Eigen::Matrix<multiFloat, 4, 1> k1, k2, k3, k4;
-    multiFloat t = 0., KE, PE;
+    using State = Eigen::Matrix<Scalar, 4, 1>;
+
+    // 重力加速度
+    const Scalar g = Scalar(980665)/Scalar(100000);
+
+    // 時間パラメータ
+    const Scalar tlim = Scalar(100);
+    const Scalar dt = Scalar(1)/Scalar(100);
+
+    // 振り子のパラメータ
+    const Scalar m1 = Scalar(5);
+    const Scalar m2 = Scalar(2);
+    const Scalar l1 = Scalar(1)/Scalar(2);
+    const Scalar l2 = Scalar(1);
+
+    // 運動方程式
+    void updateCondition(const State &condition, State &dcondition) const {
+        const Scalar theta1 = condition(0,0);
+        const Scalar theta2 = condition(1,0);
+        const Scalar dtheta1 = condition(2,0);
+        const Scalar dtheta2 = condition(3,0);
+        const Scalar s = sin(theta1 - theta2);
+        const Scalar c = cos(theta1 - theta2);
+
+        Eigen::Matrix<Scalar, 2, 2> A;
+        A << (m1 + m2)*l1, m2*l2*c,
+             l1*l2*c, l2*l2;
+        Eigen::Matrix<Scalar, 2, 1> b;
+        b << -m2*l2*dtheta2*dtheta2*s - (m1 + m2)*g*sin(theta1),
+             l1*l2*dtheta1*dtheta1*s - g*l2*sin(theta2);
+        const Eigen::Matrix<Scalar, 2, 1> x = LinearSolver<Scalar, 2>::solve(A, b);
+
+        dcondition << dtheta1, dtheta2, x(0), x(1);
+    }
+
+    State initialCondition() const {
+        Scalar theta1 = pi<Scalar>() * 2 / 2;
+        Scalar theta2 = pi<Scalar>() * 0 / 2;
+        Scalar dtheta1 = 0;
+        Scalar dtheta2 = Scalar(1)/Scalar(1000);
+
+        return State{
+            theta1,
+            theta2,
+            dtheta1,
+            dtheta2
+        };
+    }
+
+    Scalar potentialEnergy(const State &x) const {
+        const Scalar theta1 = x(0,0);
+        const Scalar theta2 = x(1,0);
+        return -m1*g*l1*cos(theta1) - m2*g*(l1*cos(theta1) + l2*cos(theta2));
+    }
+
+    Scalar kineticEnergy(const State &x) const {
+        const Scalar theta1 = x(0,0);
+        const Scalar theta2 = x(1,0);
+        const Scalar dtheta1 = x(2,0);
+        const Scalar dtheta2 = x(3,0);
+
+        return m1*l1*l1*dtheta1*dtheta1/2 + m2*(l1*l1*dtheta1*dtheta1 + l2*l2*dtheta2*dtheta2 + 2*l1*l2*dtheta1*dtheta2*cos(theta1 - theta2))/2;
+    }
+};
+
+// 振り子を動かしてdata.csvとgifを作る
+template<class Scalar>
+void simulate(){
+    const DoublePendulum<Scalar> p;
+    auto f = [&p](const typename DoublePendulum<Scalar>::State &x, typename DoublePendulum<Scalar>::State &dx, const Scalar &){ p.updateCondition(x, dx); };
+    typename DoublePendulum<Scalar>::State x = p.initialCondition();
+    ode::RK4<typename DoublePendulum<Scalar>::State, Scalar> rk4;
+    Scalar t = 0, KE, PE;
 
     // 出力ファイル
     std::fstream data;
@@ -100,20 +169,20 @@ int main()
     fprintf(gp, "set size square\n");
     fprintf(gp, "set term gif animate optimize delay 1 size 360,360\n");
     fprintf(gp, "set output 'movie.gif'\n");
-    fprintf(gp, "set xr [%f:%f]\n", static_cast<float>(-l1 - l2), static_cast<float>(l1 + l2));
-    fprintf(gp, "set yr [%f:%f]\n", static_cast<float>(-l1 - l2), static_cast<float>(l1 + l2));
+    fprintf(gp, "set xr [%f:%f]\n", static_cast<float>(-p.l1 - p.l2), static_cast<float>(p.l1 + p.l2));
+    fprintf(gp, "set yr [%f:%f]\n", static_cast<float>(-p.l1 - p.l2), static_cast<float>(p.l1 + p.l2));
 
-    for(int i = 0; t < tlim; ++i){
-        KE = kineticEnergy(x);
-        PE = potentialEnergy(x);
-        std::cout << i*dt << " " << KE + PE << std::endl; // エネルギーが保存されているか確認
+    for(int i = 0; t < p.tlim; ++i){
+        KE = p.kineticEnergy(x);
+        PE = p.potentialEnergy(x);
+        std::cout << Scalar(i*p.dt) << " " << Scalar(KE + PE) << std::endl; // エネルギーが保存されているか確認
 
         if (i%10==0){
             // gnuplot
             fprintf(gp, "plot '-' w lp lw 3\n");
             fprintf(gp, "0.0 0.0\n");
-            fprintf(gp, "%f %f\n", static_cast<float>(l1*sin(x(0,0))), static_cast<float>(-l1*cos(x(0,0))));
-            fprintf(gp, "%f %f\n", static_cast<float>(l1*sin(x(0,0)) + l2*sin(x(1,0))), static_cast<float>(-l1*cos(x(0,0)) - l2*cos(x(1,0))));
+            fprintf(gp, "%f %f\n", static_cast<float>(p.l1*sin(x(0,0))), static_cast<float>(-p.l1*cos(x(0,0))));
+            fprintf(gp, "%f %f\n", static_cast<float>(p.l1*sin(x(0,0)) + p.l2*sin(x(1,0))), static_cast<float>(-p.l1*cos(x(0,0)) - p.l2*cos(x(1,0))));
             fprintf(gp, "e\n");
         }
 
@@ -121,14 +190,101 @@ int main()
         data << x(0,0) << "," << x(1,0) << "," << x(2,0) << "," << x(3,0) << std::endl;
 
         // RK4
-        k1 = updateCondition(x);
-        k2 = updateCondition(x + dt/2*k1);
-        k3 = updateCondition(x + dt/2*k2);
-        k4 = updateCondition(x + dt*k3);
-
-        x += dt/6*(k1 + 2*k2 + 2*k3 + k4);
-        t += dt;
+        rk4.step(f, x, t, p.dt);
+        t += p.dt;
     }
     pclose(gp);
     data.close();
 }
+
+// 比べる基準の型
+using Reference = mp::cpp_dec_float_100;
+
+template<class Scalar>
+Reference toReference(const Scalar &x){
+    return Reference(x);
+}
+
+template<int N>
+Reference toReference(const MultiDouble<N> &x){
+    Reference r = 0;
+    for(int i = 0; i < N; i++) r += x[i];
+    return r;
+}
+
+// 時刻tendまで進めた(θ1, θ2)と1ステップの時間(秒)
+template<class Scalar>
+void run(const double tend, Reference &theta1, Reference &theta2, double &sec){
+    const DoublePendulum<Scalar> p;
+    auto f = [&p](const typename DoublePendulum<Scalar>::State &x, typename DoublePendulum<Scalar>::State &dx, const Scalar &){ p.updateCondition(x, dx); };
+    typename DoublePendulum<Scalar>::State x = p.initialCondition();
+    ode::RK4<typename DoublePendulum<Scalar>::State, Scalar> rk4;
+    const int steps = static_cast<int>(std::lround(tend*100));
+    const auto start = std::chrono::steady_clock::now();
+    Scalar t = 0;
+    for(int i = 0; i < steps; i++){
+        rk4.step(f, x, t, p.dt);
+        t += p.dt;
+    }
+    sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()/std::max(1, steps);
+    theta1 = toReference(x(0,0));
+    theta2 = toReference(x(1,0));
+}
+
+// 型ごとの速さと結果を比べる
+// 差はReferenceで求めてから表示する
+void compare(const double tend){
+    Reference ref1, ref2;
+    double ref_sec;
+    run<Reference>(tend, ref1, ref2, ref_sec);
+    auto report = [&](const char *name, void (*f)(double, Reference&, Reference&, double&)){
+        Reference theta1, theta2;
+        double sec;
+        f(tend, theta1, theta2, sec);
+        const double d1 = static_cast<double>(abs(Reference(theta1 - ref1)));
+        const double d2 = static_cast<double>(abs(Reference(theta2 - ref2)));
+        std::printf("%-9s %12.3f %10.1f %12.3e %12.3e\n", name, sec*1e6, ref_sec/sec, d1, d2);
+    };
+    std::printf("%-9s %12s %10s %12s %12s\n", "scalar", "us/step", "speedup", "|dtheta1|", "|dtheta2|");
+    report("double", run<double>);
+    report("dd", run<DoubleDouble>);
+    report("qd", run<QuadDouble>);
+#ifdef __SIZEOF_FLOAT128__
+    report("float128", run<mp::float128>);
+#endif
+    report("bin50", run<mp::cpp_bin_float_50>);
+    report("bin100", run<mp::cpp_bin_float_100>);
+#ifdef USE_MPFR
+    report("mpfr100", run<mp::mpfr_float_100>);
+#endif
+    report("dec100", run<Reference>);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string scalar = "dec100";
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if(arg == "--scalar" && i + 1 < argc) scalar = argv[++i];
+        else if(arg == "--compare" && i + 1 < argc){
+            compare(std::stod(argv[++i]));
+            return 0;
+        }
+    }
+    if(scalar == "double") simulate<double>();
+    else if(scalar == "dd") simulate<DoubleDouble>();
+    else if(scalar == "qd") simulate<QuadDouble>();
+#ifdef __SIZEOF_FLOAT128__
+    else if(scalar == "float128") simulate<mp::float128>();
+#endif
+    else if(scalar == "bin50") simulate<mp::cpp_bin_float_50>();
+    else if(scalar == "bin100") simulate<mp::cpp_bin_float_100>();
+#ifdef USE_MPFR
+    else if(scalar == "mpfr100") simulate<mp::mpfr_float_100>();
+#endif
+    else if(scalar == "dec100") simulate<mp::cpp_dec_float_100>();
+    else{
+        std::cerr << "unknown scalar " << scalar << std::endl;
+        return 1;
+    }
+}
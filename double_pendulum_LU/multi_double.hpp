@@ -0,0 +1,480 @@
+/**
+ * @file multi_double.hpp
+ * @brief doubleをN個並べた拡張精度の浮動小数点数(double-double, quad-double)
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+#include <Eigen/Core>
+
+/**
+ * @brief 誤差なしの和 a + b = s + err
+ */
+inline double two_sum(const double a, const double b, double &err){
+    const double s = a + b;
+    const double bb = s - a;
+    err = (a - (s - bb)) + (b - bb);
+    return s;
+}
+
+/**
+ * @brief |a| >= |b|のときの誤差なしの和
+ */
+inline double fast_two_sum(const double a, const double b, double &err){
+    const double s = a + b;
+    err = b - (s - a);
+    return s;
+}
+
+/**
+ * @brief 誤差なしの積 a*b = p + err(fmaを使う)
+ */
+inline double two_prod(const double a, const double b, double &err){
+    const double p = a*b;
+    err = std::fma(a, b, -p);
+    return p;
+}
+
+/**
+ * @brief 3つの和を大きい順の3つに直す(QDライブラリのthree_sum)
+ */
+inline void three_sum(double &a, double &b, double &c){
+    double t2, t3;
+    const double t1 = two_sum(a, b, t2);
+    a = two_sum(c, t1, t3);
+    b = two_sum(t2, t3, c);
+}
+
+/**
+ * @brief 3つの和を大きい順の2つに直す(3つ目は丸める)
+ */
+inline void three_sum2(double &a, double &b, const double c){
+    double t2, t3;
+    const double t1 = two_sum(a, b, t2);
+    a = two_sum(c, t1, t3);
+    b = t2 + t3;
+}
+
+/**
+ * @brief (a, b)にcを足し，あふれた上位の成分を返す(無ければ0)
+ */
+inline double quick_three_accum(double &a, double &b, const double c){
+    double s = two_sum(b, c, b);
+    s = two_sum(a, s, a);
+    const bool za = a != 0., zb = b != 0.;
+    if(za && zb) return s;
+    if(!zb){
+        b = a;
+        a = s;
+    }
+    else a = s;
+    return 0.;
+}
+
+/**
+ * @brief 重なりのある4成分を重ならない4成分に直す(QDライブラリのrenorm)
+ */
+inline void renormalize(double &c0, double &c1, double &c2, double &c3){
+    double s0, s1, s2 = 0., s3 = 0.;
+    s0 = fast_two_sum(c2, c3, c3);
+    s0 = fast_two_sum(c1, s0, c2);
+    c0 = fast_two_sum(c0, s0, c1);
+    s0 = c0;
+    s1 = c1;
+    if(s1 != 0.){
+        s1 = fast_two_sum(s1, c2, s2);
+        if(s2 != 0.) s2 = fast_two_sum(s2, c3, s3);
+        else s1 = fast_two_sum(s1, c3, s2);
+    }
+    else{
+        s0 = fast_two_sum(s0, c2, s1);
+        if(s1 != 0.) s1 = fast_two_sum(s1, c3, s2);
+        else s0 = fast_two_sum(s0, c3, s1);
+    }
+    c0 = s0; c1 = s1; c2 = s2; c3 = s3;
+}
+
+/**
+ * @brief 重なりのある5成分を重ならない4成分に直す(QDライブラリのrenorm)
+ */
+inline void renormalize(double &c0, double &c1, double &c2, double &c3, double &c4){
+    double s0, s1, s2 = 0., s3 = 0.;
+    s0 = fast_two_sum(c3, c4, c4);
+    s0 = fast_two_sum(c2, s0, c3);
+    s0 = fast_two_sum(c1, s0, c2);
+    c0 = fast_two_sum(c0, s0, c1);
+    s0 = c0;
+    s1 = c1;
+    if(s1 != 0.){
+        s1 = fast_two_sum(s1, c2, s2);
+        if(s2 != 0.){
+            s2 = fast_two_sum(s2, c3, s3);
+            if(s3 != 0.) s3 += c4;
+            else s2 = fast_two_sum(s2, c4, s3);
+        }
+        else{
+            s1 = fast_two_sum(s1, c3, s2);
+            if(s2 != 0.) s2 = fast_two_sum(s2, c4, s3);
+            else s1 = fast_two_sum(s1, c4, s2);
+        }
+    }
+    else{
+        s0 = fast_two_sum(s0, c2, s1);
+        if(s1 != 0.){
+            s1 = fast_two_sum(s1, c3, s2);
+            if(s2 != 0.) s2 = fast_two_sum(s2, c4, s3);
+            else s1 = fast_two_sum(s1, c4, s2);
+        }
+        else{
+            s0 = fast_two_sum(s0, c3, s1);
+            if(s1 != 0.) s1 = fast_two_sum(s1, c4, s2);
+            else s0 = fast_two_sum(s0, c4, s1);
+        }
+    }
+    c0 = s0; c1 = s1; c2 = s2; c3 = s3;
+}
+
+/**
+ * @brief 重なりのないdoubleの列(絶対値の小さい順)で表した誤差なしの和(Shewchukのexpansion)
+ * @details growで1つのdoubleを誤差なしに足す．0になった成分は捨てる．
+ */
+template<int Capacity>
+struct Expansion{
+    double e[Capacity];
+    int n = 0;
+    void grow(const double b){
+        double q = b;
+        int k = 0;
+        for(int i = 0; i < n; i++){
+            double h;
+            q = two_sum(q, e[i], h);
+            if(h != 0.) e[k++] = h;
+        }
+        e[k++] = q;
+        n = k;
+    }
+};
+
+/**
+ * @brief doubleをN個並べた拡張精度の浮動小数点数
+ * @details 値はx[0] + x[1] + ... + x[N-1]で，x[0]が最も大きく，成分同士は重ならない．精度は約53Nビット．
+ *          和は誤差なしのexpansionで求めてから大きいほうのN個に丸める．積はx[i]*y[j](i + j < N)を誤差なしに，
+ *          i + j = Nの項だけを丸めて足す．商は1成分ずつ割っていく長除法．sinとcosはπ/2の倍数を引いてからTaylor展開で求める．
+ *          N = 2(double-double)とN = 4(quad-double)の和と積はexpansionを使わずQDライブラリと同じ式で求める
+ *          (N = 4の積はQDのsloppy_mulで，誤差は数ulp)．exponentの範囲はdoubleと同じ．
+ */
+template<int N>
+class MultiDouble{
+    static_assert(N >= 2, "N must be at least 2");
+private:
+    double x[N];
+
+    MultiDouble(const double hi, const double lo) : x{} { x[0] = hi; x[1] = lo; }
+
+    /**
+     * @brief expansionを大きいほうのN成分に丸める(ShewchukのCompress)
+     */
+    template<int Capacity>
+    static MultiDouble from_expansion(Expansion<Capacity> &a){
+        MultiDouble r;
+        if(a.n == 0) return r;
+        double *e = a.e;
+        double q = e[a.n - 1];
+        int bottom = a.n - 1;
+        for(int i = a.n - 2; i >= 0; i--){
+            double err;
+            const double s = fast_two_sum(q, e[i], err);
+            if(err != 0.){
+                e[bottom--] = s;
+                q = err;
+            }
+            else q = s;
+        }
+        e[bottom] = q;
+        int top = 0;
+        for(int i = bottom + 1; i < a.n; i++){
+            double err;
+            q = fast_two_sum(e[i], q, err);
+            if(err != 0.) e[top++] = err;
+        }
+        e[top++] = q;
+        for(int i = 0; i < N && i < top; i++) r.x[i] = e[top - 1 - i];
+        return r;
+    }
+
+    /**
+     * @brief π/4以下の数rのsinかcosのTaylor展開
+     * @details 項の比の1/(k(k + 1))は最初に表にしておき，割り算を使わない．
+     */
+    static MultiDouble series(const MultiDouble &r, const bool cosine){
+        constexpr int terms = 20*N;
+        static const auto inverse = [](){
+            std::array<MultiDouble, terms + 2> t;
+            for(int k = 1; k <= terms; k++) t[k] = MultiDouble(1.)/MultiDouble(static_cast<double>(k)*(k + 1));
+            return t;
+        }();
+        const MultiDouble r2 = r*r;
+        MultiDouble term = cosine ? MultiDouble(1.) : r;
+        MultiDouble sum = term;
+        const double eps = std::ldexp(1., -53*N);
+        for(int k = cosine ? 1 : 2; k <= terms; k += 2){
+            term = -(term*r2)*inverse[k];
+            sum += term;
+            if(std::abs(term.x[0]) <= eps*std::abs(sum.x[0])) break;
+        }
+        return sum;
+    }
+
+    /**
+     * @brief sinかcosを求める
+     */
+    static MultiDouble sin_cos(const MultiDouble &a, const bool cosine){
+        const MultiDouble half_pi = pi()*0.5;
+        const double k = std::nearbyint(a.x[0]/(M_PI/2.));
+        const MultiDouble r = a - half_pi*k;
+        const int q = (static_cast<long long>(k) % 4 + 4 + (cosine ? 1 : 0)) % 4;
+        // sin(r + qπ/2)
+        const MultiDouble v = series(r, q % 2 == 1);
+        return q >= 2 ? -v : v;
+    }
+public:
+    MultiDouble() : x{} {}
+    MultiDouble(const double d) : x{} { x[0] = d; }
+    MultiDouble(const int d) : MultiDouble(static_cast<double>(d)) {}
+    explicit operator double() const { return x[0] + x[1]; }
+    explicit operator float() const { return static_cast<float>(x[0] + x[1]); }
+    /**
+     * @brief i番目の成分(0が最も大きい)
+     */
+    double operator[](const int i) const { return x[i]; }
+
+    /**
+     * @brief π(N成分)
+     */
+    static MultiDouble pi(){
+        static const double c[4] = {3.141592653589793116e+00, 1.224646799147353207e-16, -2.994769809718339666e-33, 1.112454220863365282e-49};
+        static_assert(N <= 4, "pi is given up to 4 components");
+        MultiDouble r;
+        for(int i = 0; i < N; i++) r.x[i] = c[i];
+        return r;
+    }
+
+    friend MultiDouble operator-(const MultiDouble &a){
+        MultiDouble r;
+        for(int i = 0; i < N; i++) r.x[i] = -a.x[i];
+        return r;
+    }
+    friend MultiDouble operator+(const MultiDouble &a, const MultiDouble &b){
+        if constexpr(N == 2){
+            // double-doubleはQDライブラリの式(IEEE和)で求める
+            double s1, s2, t1, t2;
+            s1 = two_sum(a.x[0], b.x[0], s2);
+            t1 = two_sum(a.x[1], b.x[1], t2);
+            s2 += t1;
+            s1 = fast_two_sum(s1, s2, s2);
+            s2 += t2;
+            MultiDouble r;
+            r.x[0] = fast_two_sum(s1, s2, r.x[1]);
+            return r;
+        }
+        if constexpr(N == 4){
+            // 絶対値の大きい順に併合しながら足す(QDライブラリのieee_add)
+            int i = 0, j = 0, k = 0;
+            double u, v, t;
+            MultiDouble r;
+            u = std::abs(a.x[i]) > std::abs(b.x[j]) ? a.x[i++] : b.x[j++];
+            v = std::abs(a.x[i]) > std::abs(b.x[j]) ? a.x[i++] : b.x[j++];
+            u = fast_two_sum(u, v, v);
+            while(k < 4){
+                if(i >= 4 && j >= 4){
+                    r.x[k] = u;
+                    if(k < 3) r.x[++k] = v;
+                    break;
+                }
+                if(i >= 4) t = b.x[j++];
+                else if(j >= 4) t = a.x[i++];
+                else if(std::abs(a.x[i]) > std::abs(b.x[j])) t = a.x[i++];
+                else t = b.x[j++];
+                const double s = quick_three_accum(u, v, t);
+                if(s != 0.) r.x[k++] = s;
+            }
+            for(k = i; k < 4; k++) r.x[3] += a.x[k];
+            for(k = j; k < 4; k++) r.x[3] += b.x[k];
+            renormalize(r.x[0], r.x[1], r.x[2], r.x[3]);
+            return r;
+        }
+        Expansion<2*N> e;
+        for(int i = N - 1; i >= 0; i--) if(a.x[i] != 0.) e.e[e.n++] = a.x[i];
+        for(int i = N - 1; i >= 0; i--) e.grow(b.x[i]);
+        return from_expansion(e);
+    }
+    friend MultiDouble operator-(const MultiDouble &a, const MultiDouble &b){
+        return a + (-b);
+    }
+    friend MultiDouble operator*(const MultiDouble &a, const MultiDouble &b){
+        if constexpr(N == 2){
+            double p2;
+            const double p1 = two_prod(a.x[0], b.x[0], p2);
+            p2 += a.x[0]*b.x[1] + a.x[1]*b.x[0];
+            MultiDouble r;
+            r.x[0] = fast_two_sum(p1, p2, r.x[1]);
+            return r;
+        }
+        if constexpr(N == 4){
+            // 次数の低い項だけ誤差なしに求める(QDライブラリのsloppy_mul)
+            double q0, q1, q2, q3, q4, q5, t0, t1;
+            double p0 = two_prod(a.x[0], b.x[0], q0);
+            double p1 = two_prod(a.x[0], b.x[1], q1);
+            double p2 = two_prod(a.x[1], b.x[0], q2);
+            double p3 = two_prod(a.x[0], b.x[2], q3);
+            double p4 = two_prod(a.x[1], b.x[1], q4);
+            double p5 = two_prod(a.x[2], b.x[0], q5);
+            three_sum(p1, p2, q0);
+            three_sum(p2, q1, q2);
+            three_sum(p3, p4, p5);
+            double s0 = two_sum(p2, p3, t0);
+            double s1 = two_sum(q1, p4, t1);
+            double s2 = q2 + p5;
+            s1 = two_sum(s1, t0, t0);
+            s2 += t0 + t1;
+            s1 += a.x[0]*b.x[3] + a.x[1]*b.x[2] + a.x[2]*b.x[1] + a.x[3]*b.x[0] + q0 + q3 + q4 + q5;
+            renormalize(p0, p1, s0, s1, s2);
+            MultiDouble r;
+            r.x[0] = p0; r.x[1] = p1; r.x[2] = s0; r.x[3] = s1;
+            return r;
+        }
+        Expansion<N*(N + 1) + N> e;
+        // 小さい項から足す
+        for(int d = N; d >= 0; d--){
+            for(int i = 0; i <= d; i++){
+                const int j = d - i;
+                if(i >= N || j >= N) continue;
+                if(d == N) e.grow(a.x[i]*b.x[j]);
+                else{
+                    double err;
+                    const double p = two_prod(a.x[i], b.x[j], err);
+                    e.grow(err);
+                    e.grow(p);
+                }
+            }
+        }
+        return from_expansion(e);
+    }
+    friend MultiDouble operator*(const MultiDouble &a, const double b){
+        if constexpr(N == 2){
+            double p2;
+            const double p1 = two_prod(a.x[0], b, p2);
+            p2 += a.x[1]*b;
+            MultiDouble r;
+            r.x[0] = fast_two_sum(p1, p2, r.x[1]);
+            return r;
+        }
+        if constexpr(N == 4){
+            double q0, q1, q2, s2;
+            const double p0 = two_prod(a.x[0], b, q0);
+            const double p1 = two_prod(a.x[1], b, q1);
+            double p2 = two_prod(a.x[2], b, q2);
+            const double p3 = a.x[3]*b;
+            MultiDouble r;
+            r.x[0] = p0;
+            r.x[1] = two_sum(q0, p1, s2);
+            three_sum(s2, q1, p2);
+            three_sum2(q1, q2, p3);
+            r.x[2] = s2;
+            r.x[3] = q1;
+            double s4 = q2 + p2;
+            renormalize(r.x[0], r.x[1], r.x[2], r.x[3], s4);
+            return r;
+        }
+        Expansion<2*N> e;
+        for(int i = N - 1; i >= 0; i--){
+            double err;
+            const double p = two_prod(a.x[i], b, err);
+            e.grow(err);
+            e.grow(p);
+        }
+        return from_expansion(e);
+    }
+    friend MultiDouble operator*(const double a, const MultiDouble &b){
+        return b*a;
+    }
+    friend MultiDouble operator/(const MultiDouble &a, const MultiDouble &b){
+        if constexpr(N == 2){
+            const double q1 = a.x[0]/b.x[0];
+            MultiDouble r = a - b*q1;
+            const double q2 = r.x[0]/b.x[0];
+            r -= b*q2;
+            const double q3 = r.x[0]/b.x[0];
+            double e;
+            const double q = fast_two_sum(q1, q2, e);
+            return MultiDouble(q, e) + MultiDouble(q3);
+        }
+        // 商の成分をN + 1個求めて足す
+        Expansion<N + 1> q;
+        double qs[N + 1];
+        MultiDouble r = a;
+        for(int k = 0; k <= N; k++){
+            qs[k] = r.x[0]/b.x[0];
+            if(k < N) r = r - b*qs[k];
+        }
+        for(int k = N; k >= 0; k--) q.grow(qs[k]);
+        return from_expansion(q);
+    }
+    MultiDouble &operator+=(const MultiDouble &b){ return *this = *this + b; }
+    MultiDouble &operator-=(const MultiDouble &b){ return *this = *this - b; }
+    MultiDouble &operator*=(const MultiDouble &b){ return *this = *this*b; }
+    MultiDouble &operator/=(const MultiDouble &b){ return *this = *this/b; }
+
+    friend bool operator<(const MultiDouble &a, const MultiDouble &b){ return (a - b).x[0] < 0.; }
+    friend bool operator>(const MultiDouble &a, const MultiDouble &b){ return b < a; }
+    friend bool operator<=(const MultiDouble &a, const MultiDouble &b){ return !(b < a); }
+    friend bool operator>=(const MultiDouble &a, const MultiDouble &b){ return !(a < b); }
+    friend bool operator==(const MultiDouble &a, const MultiDouble &b){ return (a - b).x[0] == 0.; }
+    friend bool operator!=(const MultiDouble &a, const MultiDouble &b){ return !(a == b); }
+
+    friend MultiDouble abs(const MultiDouble &a){ return a.x[0] < 0. ? -a : a; }
+    friend MultiDouble sin(const MultiDouble &a){ return sin_cos(a, false); }
+    friend MultiDouble cos(const MultiDouble &a){ return sin_cos(a, true); }
+
+    /**
+     * @brief doubleに直して出力する
+     */
+    friend std::ostream &operator<<(std::ostream &os, const MultiDouble &a){
+        return os << static_cast<double>(a);
+    }
+};
+
+using DoubleDouble = MultiDouble<2>;
+using QuadDouble = MultiDouble<4>;
+
+namespace Eigen {
+
+template<int N>
+struct NumTraits<MultiDouble<N> > : GenericNumTraits<MultiDouble<N> >{
+    using Real = MultiDouble<N>;
+    using NonInteger = MultiDouble<N>;
+    using Literal = MultiDouble<N>;
+    using Nested = MultiDouble<N>;
+    enum{
+        IsComplex = 0,
+        IsInteger = 0,
+        IsSigned = 1,
+        RequireInitialization = 1,
+        ReadCost = N,
+        AddCost = 8*N*N,
+        MulCost = 16*N*N
+    };
+    static inline Real epsilon(){ return std::ldexp(1., -53*N); }
+    static inline Real dummy_precision(){ return std::ldexp(1., -50*N); }
+    static inline Real highest(){ return std::numeric_limits<double>::max(); }
+    static inline Real lowest(){ return -std::numeric_limits<double>::max(); }
+    static inline int digits10(){ return static_cast<int>(53*N*0.30103); }
+};
+
+} // namespace Eigen
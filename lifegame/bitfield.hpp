@@ -0,0 +1,177 @@
+/**
+ * @file bitfield.hpp
+ * @brief bit-packed field of Game of Life and its update kernel
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>      // size_t
+#include <algorithm>    // fill
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief bit-packed lattice, 64 cells per word
+ * @details 1行をuint64_tの列として持つ．yが小さいセルほど下位ビット．
+ *          各行の左右に1ワード，上下に1行ずつ常に0のパディングを持たせて，近傍参照で範囲チェックをしなくて済むようにする．
+ */
+class BitField{
+private:
+    int _rows, _cols;
+    int _words;     // 1行のワード数(パディングを除く)
+    int _stride;    // 1行のワード数(パディングを含む)
+    std::vector<std::uint64_t> data;
+public:
+    static constexpr int bits = 64;
+    BitField(const int rows, const int cols);
+    int rows() const { return _rows; }
+    int cols() const { return _cols; }
+    int words() const { return _words; }
+    std::uint64_t *row(const int x) { return data.data() + (x + 1)*_stride + 1; }
+    const std::uint64_t *row(const int x) const { return data.data() + (x + 1)*_stride + 1; }
+    std::uint64_t tail_mask() const;
+    bool get(const int x, const int y) const;
+    void set(const int x, const int y, const bool alive);
+    void clear();
+    std::size_t population() const;
+};
+
+/**
+ * @brief allocate zero-filled field
+ * @param[in] rows number of rows, cols number of columns
+ */
+inline BitField::BitField(const int rows, const int cols)
+    : _rows(rows)
+    , _cols(cols)
+    , _words((cols + bits - 1) / bits)
+    , _stride(_words + 2)
+    , data(static_cast<std::size_t>(rows + 2) * _stride, 0)
+{
+}
+
+/**
+ * @brief mask of valid bits in the last word of a row
+ */
+inline std::uint64_t BitField::tail_mask() const {
+    const int r = _cols % bits;
+    return r == 0 ? ~std::uint64_t(0) : (std::uint64_t(1) << r) - 1;
+}
+
+/**
+ * @brief read cell (x, y), no bounds check
+ */
+inline bool BitField::get(const int x, const int y) const {
+    return (row(x)[y / bits] >> (y % bits)) & 1;
+}
+
+/**
+ * @brief write cell (x, y), no bounds check
+ */
+inline void BitField::set(const int x, const int y, const bool alive){
+    std::uint64_t &w = row(x)[y / bits];
+    const std::uint64_t b = std::uint64_t(1) << (y % bits);
+    if(alive) w |= b;
+    else w &= ~b;
+}
+
+/**
+ * @brief kill all cells
+ */
+inline void BitField::clear(){
+    std::fill(data.begin(), data.end(), 0);
+}
+
+/**
+ * @brief number of alive cells
+ */
+inline std::size_t BitField::population() const {
+    std::size_t n = 0;
+    for(auto&& w : data) n += __builtin_popcountll(w);
+    return n;
+}
+
+/**
+ * @brief next generation of 64 cells by bit-sliced addition (B3/S23)
+ * @param[in] uw, uc, ue 上の行の西・中央・東, mw, mc, me 同じ行, dw, dc, de 下の行
+ * @details 近傍8セルを全加算器で足し合わせ，個数の1の位(ones)と2の位以上をビットごとに並列に求める．
+ *          2の位の合計がちょうど1，すなわち個数が2か3のときだけ残り，個数3(ones=1)か生存セルなら次もalive．
+ */
+inline std::uint64_t life_word(const std::uint64_t uw, const std::uint64_t uc, const std::uint64_t ue,
+                               const std::uint64_t mw, const std::uint64_t mc, const std::uint64_t me,
+                               const std::uint64_t dw, const std::uint64_t dc, const std::uint64_t de){
+    // 上の行と下の行は3入力，同じ行は2入力の加算
+    const std::uint64_t ut = uw ^ uc, us = ut ^ ue, u2 = (uw & uc) | (ut & ue);
+    const std::uint64_t dt = dw ^ dc, ds = dt ^ de, d2 = (dw & dc) | (dt & de);
+    const std::uint64_t ms = mw ^ me, m2 = mw & me;
+    // 1の位
+    const std::uint64_t ot = us ^ ms, ones = ot ^ ds, o2 = (us & ms) | (ot & ds);
+    // 2の位の個数(u2, d2, m2, o2の合計)がちょうど1か
+    const std::uint64_t tt = u2 ^ d2, ts = tt ^ m2, t4 = (u2 & d2) | (tt & m2);
+    return ~t4 & (ts ^ o2) & (ones | mc);
+}
+
+#ifdef __AVX2__
+/**
+ * @brief AVX2 version of life_word, 4 words at once
+ */
+inline __m256i life_word(const __m256i uw, const __m256i uc, const __m256i ue,
+                         const __m256i mw, const __m256i mc, const __m256i me,
+                         const __m256i dw, const __m256i dc, const __m256i de){
+    const __m256i ut = _mm256_xor_si256(uw, uc);
+    const __m256i us = _mm256_xor_si256(ut, ue);
+    const __m256i u2 = _mm256_or_si256(_mm256_and_si256(uw, uc), _mm256_and_si256(ut, ue));
+    const __m256i dt = _mm256_xor_si256(dw, dc);
+    const __m256i ds = _mm256_xor_si256(dt, de);
+    const __m256i d2 = _mm256_or_si256(_mm256_and_si256(dw, dc), _mm256_and_si256(dt, de));
+    const __m256i ms = _mm256_xor_si256(mw, me);
+    const __m256i m2 = _mm256_and_si256(mw, me);
+    const __m256i ot = _mm256_xor_si256(us, ms);
+    const __m256i ones = _mm256_xor_si256(ot, ds);
+    const __m256i o2 = _mm256_or_si256(_mm256_and_si256(us, ms), _mm256_and_si256(ot, ds));
+    const __m256i tt = _mm256_xor_si256(u2, d2);
+    const __m256i ts = _mm256_xor_si256(tt, m2);
+    const __m256i t4 = _mm256_or_si256(_mm256_and_si256(u2, d2), _mm256_and_si256(tt, m2));
+    return _mm256_andnot_si256(t4, _mm256_and_si256(_mm256_xor_si256(ts, o2), _mm256_or_si256(ones, mc)));
+}
+
+/**
+ * @brief west and east neighbors of 4 words starting at p
+ */
+inline void shift_we(const std::uint64_t *p, __m256i &w, __m256i &c, __m256i &e){
+    const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p - 1));
+    const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+    c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    w = _mm256_or_si256(_mm256_slli_epi64(c, 1), _mm256_srli_epi64(l, 63));
+    e = _mm256_or_si256(_mm256_srli_epi64(c, 1), _mm256_slli_epi64(r, 63));
+}
+#endif
+
+/**
+ * @brief compute one row of the next generation
+ * @param[in] up, mid, down 上・同じ・下の行, n ワード数
+ * @param[out] out 次の世代の行
+ * @details 各行の[-1]と[n]はパディングワードとして読む．列数が64の倍数でない場合，最後のワードの余りビットは呼び出し側でマスクする．
+ */
+inline void life_row(const std::uint64_t *up, const std::uint64_t *mid, const std::uint64_t *down,
+                     std::uint64_t *out, const int n){
+    int i = 0;
+#ifdef __AVX2__
+    for(; i + 4 <= n; i += 4){
+        __m256i uw, uc, ue, mw, mc, me, dw, dc, de;
+        shift_we(up + i, uw, uc, ue);
+        shift_we(mid + i, mw, mc, me);
+        shift_we(down + i, dw, dc, de);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), life_word(uw, uc, ue, mw, mc, me, dw, dc, de));
+    }
+#endif
+    for(; i < n; i++){
+        const std::uint64_t uc = up[i], mc = mid[i], dc = down[i];
+        out[i] = life_word((uc << 1) | (up[i - 1] >> 63), uc, (uc >> 1) | (up[i + 1] << 63),
+                           (mc << 1) | (mid[i - 1] >> 63), mc, (mc >> 1) | (mid[i + 1] << 63),
+                           (dc << 1) | (down[i - 1] >> 63), dc, (dc >> 1) | (down[i + 1] << 63));
+    }
+}
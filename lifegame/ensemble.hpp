@@ -0,0 +1,99 @@
+/**
+ * @file ensemble.hpp
+ * @brief random number streams and result file of random soup ensembles
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>      // memcpy
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief splitmix64 finalizer
+ */
+inline std::uint64_t mix64(std::uint64_t z){
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief counter-based random number, a pure function of (key, counter)
+ * @details 状態を持たないので，スープごとにkeyを変えればスレッドの割り当てや実行順によらず同じ乱数列になる．
+ */
+inline std::uint64_t counter_random(const std::uint64_t key, const std::uint64_t counter){
+    return mix64(mix64(key) + counter*0x9E3779B97F4A7C15ull);
+}
+
+/**
+ * @brief key of the stream of a soup
+ */
+inline std::uint64_t soup_key(const std::uint64_t seed, const std::uint64_t soup){
+    return mix64(seed*0xD1B54A32D192ED03ull + soup);
+}
+
+/**
+ * @brief result of one soup, 16 bytes in the file
+ * @details periodが0なら最大世代までに周期に入らなかった．settledは周期に入った最初の世代．
+ */
+struct SoupResult{
+    std::uint32_t id;
+    std::uint32_t settled;
+    std::uint32_t period;
+    std::uint32_t population;
+};
+
+/**
+ * @brief buffered writer of soup results shared by threads
+ * @details ファイルの先頭は"LGSOUP1\0"のあとにuint32でL, soup, max_gen, uint64でseed(計28バイト)．
+ *          そのあとにSoupResultが終わった順に並ぶ．バイトオーダーは実行した計算機のもの．
+ */
+class SoupWriter{
+private:
+    std::ofstream file;
+    std::mutex m;
+    std::vector<SoupResult> buffer;
+    static constexpr std::size_t capacity = 4096;
+    void flush_locked();
+public:
+    SoupWriter(const std::string &filename, const std::uint32_t L, const std::uint32_t soup, const std::uint32_t max_gen, const std::uint64_t seed);
+    ~SoupWriter();
+    bool good() const { return file.good(); }
+    void write(const SoupResult &r);
+};
+
+inline SoupWriter::SoupWriter(const std::string &filename, const std::uint32_t L, const std::uint32_t soup, const std::uint32_t max_gen, const std::uint64_t seed)
+    : file(filename, std::ios::binary)
+{
+    char header[24] = "LGSOUP1";
+    std::memcpy(header + 8, &L, 4);
+    std::memcpy(header + 12, &soup, 4);
+    std::memcpy(header + 16, &max_gen, 4);
+    file.write(header, 20);
+    file.write(reinterpret_cast<const char*>(&seed), 8);
+    buffer.reserve(capacity);
+}
+
+inline SoupWriter::~SoupWriter(){
+    std::lock_guard<std::mutex> lock(m);
+    flush_locked();
+}
+
+inline void SoupWriter::flush_locked(){
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()*sizeof(SoupResult));
+    buffer.clear();
+}
+
+/**
+ * @brief append a result, written to the file every 4096 results
+ */
+inline void SoupWriter::write(const SoupResult &r){
+    std::lock_guard<std::mutex> lock(m);
+    buffer.push_back(r);
+    if(buffer.size() >= capacity) flush_locked();
+}
@@ -0,0 +1,363 @@
+/**
+ * @file hashlife.hpp
+ * @brief HashLife engine of Game of Life
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>      // size_t
+#include <algorithm>    // max
+#include <functional>   // hash
+#include <unordered_map>
+#include <vector>
+
+#include "bitfield.hpp"
+#include "rule.hpp"
+
+/**
+ * @brief hash-consed quadtree of an unbounded plane with memoized RESULT
+ * @details レベルkのノードは2^k×2^kの正方形で，子(nw, ne, sw, se)が同じノードは1つしか作らない．
+ *          ノードのRESULTは中央の2^(k-1)×2^(k-1)を2^min(j,k-2)世代進めたもので，一度計算したら覚えておく．
+ *          ルートの中心は常に原点で，(x, y)はLifeGameと同じく行・列の順．
+ *          ノード数がmax_nodesを超えたら，次のstep()の前にルートから辿れないノードを捨てる．
+ *          ルールは半径1でB0を含まないものに限る．
+ */
+class HashLife{
+private:
+    using Index = std::uint32_t;
+    using Key = std::array<Index, 4>;
+    static constexpr Index none = ~Index(0);
+    struct Node{
+        Index nw, ne, sw, se;
+        Index result;   // 未計算ならnone
+        int level;
+        std::uint64_t population;
+    };
+    struct KeyHash{
+        std::size_t operator()(const Key &k) const {
+            std::uint64_t h = k[0];
+            h = h*0x9E3779B97F4A7C15ull + k[1];
+            h = h*0x9E3779B97F4A7C15ull + k[2];
+            h = h*0x9E3779B97F4A7C15ull + k[3];
+            return static_cast<std::size_t>(h ^ (h >> 29));
+        }
+    };
+    std::vector<Node> nodes;    // nodes[0]はdead, nodes[1]はaliveのセル
+    std::vector<Index> free_list;
+    std::unordered_map<Key, Index, KeyHash> table;
+    std::vector<Index> empty;   // 各レベルの空のノード
+    Index root;
+    int step_log;               // RESULTがどの歩幅で計算されたか
+    std::size_t max_nodes;
+    std::uint64_t _generation;
+    const Rule rule;
+    Index join(const Index nw, const Index ne, const Index sw, const Index se);
+    Index empty_node(const int level);
+    Index centre(const Index n);
+    Index expand(const Index n);
+    bool inner_only(const Index n);
+    Index base(const Index n);
+    Index successor(const Index n, const int j);
+    Index build(const BitField &f, const int level, const long long x0, const long long y0);
+    void draw(const Index n, BitField &f, const long long x0, const long long y0, const long long vx, const long long vy) const;
+    void mark(const Index n, std::vector<char> &marked) const;
+    void clear_results();
+public:
+    explicit HashLife(const std::size_t max_nodes = std::size_t(1) << 22, const Rule &rule = Rule());
+    void load(const BitField &f);
+    void step(const int j);
+    void advance(std::uint64_t n);
+    void draw(BitField &f, const long long x0, const long long y0) const;
+    void gc();
+    std::uint64_t population() const { return nodes[root].population; }
+    std::uint64_t generation() const { return _generation; }
+    std::size_t size() const { return nodes.size() - free_list.size(); }
+};
+
+/**
+ * @brief make dead and alive cells and an empty root
+ * @param[in] max_nodes ノード数の上限の目安, rule rule
+ */
+inline HashLife::HashLife(const std::size_t max_nodes, const Rule &rule)
+    : root(0)
+    , step_log(-1)
+    , max_nodes(max_nodes)
+    , _generation(0)
+    , rule(rule)
+{
+    nodes.push_back({none, none, none, none, none, 0, 0});
+    nodes.push_back({none, none, none, none, none, 0, 1});
+    empty.push_back(0);
+    root = empty_node(3);
+}
+
+/**
+ * @brief find or create the node with given children
+ */
+inline HashLife::Index HashLife::join(const Index nw, const Index ne, const Index sw, const Index se){
+    const Key key = {nw, ne, sw, se};
+    auto it = table.find(key);
+    if(it != table.end()) return it->second;
+    const Node n = {nw, ne, sw, se, none, nodes[nw].level + 1,
+                    nodes[nw].population + nodes[ne].population + nodes[sw].population + nodes[se].population};
+    Index i;
+    if(free_list.empty()){
+        i = static_cast<Index>(nodes.size());
+        nodes.push_back(n);
+    }
+    else{
+        i = free_list.back();
+        free_list.pop_back();
+        nodes[i] = n;
+    }
+    table.emplace(key, i);
+    return i;
+}
+
+/**
+ * @brief empty node of the level
+ */
+inline HashLife::Index HashLife::empty_node(const int level){
+    while(static_cast<int>(empty.size()) <= level){
+        const Index e = empty.back();
+        empty.push_back(join(e, e, e, e));
+    }
+    return empty[level];
+}
+
+/**
+ * @brief central node one level below
+ */
+inline HashLife::Index HashLife::centre(const Index n){
+    const Node a = nodes[n];
+    return join(nodes[a.nw].se, nodes[a.ne].sw, nodes[a.sw].ne, nodes[a.se].nw);
+}
+
+/**
+ * @brief same pattern surrounded by empty cells, one level above
+ */
+inline HashLife::Index HashLife::expand(const Index n){
+    const Node a = nodes[n];
+    const Index e = empty_node(a.level - 1);
+    return join(join(e, e, e, a.nw), join(e, e, a.ne, e),
+                join(e, a.sw, e, e), join(a.se, e, e, e));
+}
+
+/**
+ * @brief judge if all alive cells are in the central half
+ */
+inline bool HashLife::inner_only(const Index n){
+    const Node a = nodes[n];
+    const Node nw = nodes[a.nw], ne = nodes[a.ne], sw = nodes[a.sw], se = nodes[a.se];
+    const std::uint64_t inner = nodes[nw.se].population + nodes[ne.sw].population
+                              + nodes[sw.ne].population + nodes[se.nw].population;
+    return inner == a.population;
+}
+
+/**
+ * @brief RESULT of a level 2 node by direct counting, 1 generation
+ */
+inline HashLife::Index HashLife::base(const Index n){
+    // 4×4のセルを16ビットに詰める．ビット(r*4 + c)
+    unsigned bits = 0;
+    const Node a = nodes[n];
+    const Index q[4] = {a.nw, a.ne, a.sw, a.se};
+    for(int k = 0; k < 4; k++){
+        const Node b = nodes[q[k]];
+        const Index c[4] = {b.nw, b.ne, b.sw, b.se};
+        for(int l = 0; l < 4; l++){
+            const int r = (k / 2)*2 + l / 2, s = (k % 2)*2 + l % 2;
+            if(c[l] == 1) bits |= 1u << (r*4 + s);
+        }
+    }
+    Index out[4];
+    for(int k = 0; k < 4; k++){
+        const int r = 1 + k / 2, s = 1 + k % 2;
+        int count = 0;
+        for(int i = -1; i <= 1; i++){
+            for(int j = -1; j <= 1; j++){
+                if(i == 0 && j == 0) continue;
+                count += (bits >> ((r + i)*4 + s + j)) & 1;
+            }
+        }
+        const bool cell = (bits >> (r*4 + s)) & 1;
+        out[k] = (((cell ? rule.survive : rule.birth) >> count) & 1) ? 1 : 0;
+    }
+    return join(out[0], out[1], out[2], out[3]);
+}
+
+/**
+ * @brief RESULT of node n advancing 2^min(j, level-2) generations
+ */
+inline HashLife::Index HashLife::successor(const Index n, const int j){
+    if(nodes[n].result != none) return nodes[n].result;
+    const Node a = nodes[n];
+    Index s;
+    if(a.population == 0){
+        s = empty_node(a.level - 1);
+    }
+    else if(a.level == 2){
+        s = base(n);
+    }
+    else{
+        const Node nw = nodes[a.nw], ne = nodes[a.ne], sw = nodes[a.sw], se = nodes[a.se];
+        // 9つの部分正方形をそれぞれ進める
+        const Index c00 = successor(a.nw, j);
+        const Index c01 = successor(join(nw.ne, ne.nw, nw.se, ne.sw), j);
+        const Index c02 = successor(a.ne, j);
+        const Index c10 = successor(join(nw.sw, nw.se, sw.nw, sw.ne), j);
+        const Index c11 = successor(join(nw.se, ne.sw, sw.ne, se.nw), j);
+        const Index c12 = successor(join(ne.sw, ne.se, se.nw, se.ne), j);
+        const Index c20 = successor(a.sw, j);
+        const Index c21 = successor(join(sw.ne, se.nw, sw.se, se.sw), j);
+        const Index c22 = successor(a.se, j);
+        if(j < a.level - 2){
+            // 歩幅が小さいときはこれ以上進めずに中央を取り出すだけ
+            s = join(centre(join(c00, c01, c10, c11)), centre(join(c01, c02, c11, c12)),
+                     centre(join(c10, c11, c20, c21)), centre(join(c11, c12, c21, c22)));
+        }
+        else{
+            s = join(successor(join(c00, c01, c10, c11), j), successor(join(c01, c02, c11, c12), j),
+                     successor(join(c10, c11, c20, c21), j), successor(join(c11, c12, c21, c22), j));
+        }
+    }
+    nodes[n].result = s;
+    return s;
+}
+
+/**
+ * @brief forget all RESULTs
+ */
+inline void HashLife::clear_results(){
+    for(auto&& n : nodes) n.result = none;
+}
+
+/**
+ * @brief advance 2^j generations
+ * @details 生きているセルがルートの中央半分に収まり，かつルートのレベルがj+2以上になるまで広げてから，
+ *          もう一段広げてRESULTを取る．光速(1セル/世代)で広がっても結果のノードからはみ出さない．
+ */
+inline void HashLife::step(const int j){
+    if(size() > max_nodes) gc();
+    if(j != step_log){
+        clear_results();
+        step_log = j;
+    }
+    while(nodes[root].level < j + 2 || !inner_only(root)) root = expand(root);
+    root = successor(expand(root), j);
+    while(nodes[root].level > 3 && inner_only(root)) root = centre(root);
+    _generation += std::uint64_t(1) << j;
+}
+
+/**
+ * @brief advance n generations by steps of powers of two
+ */
+inline void HashLife::advance(std::uint64_t n){
+    for(int j = 63; j >= 0; j--){
+        if((n >> j) & 1) step(j);
+    }
+}
+
+/**
+ * @brief quadtree of the aligned square [x0, x0+2^level) × [y0, y0+2^level) of a dense field
+ */
+inline HashLife::Index HashLife::build(const BitField &f, const int level, const long long x0, const long long y0){
+    const long long size = 1LL << level;
+    if(x0 >= f.rows() || y0 >= f.cols() || x0 + size <= 0 || y0 + size <= 0) return empty_node(level);
+    if(level == 0) return f.get(static_cast<int>(x0), static_cast<int>(y0)) ? 1 : 0;
+    if(level == 6 && x0 >= 0 && y0 >= 0){
+        // 1ワード分の幅がすべて0なら空
+        bool zero = true;
+        for(long long x = x0; x < x0 + size && x < f.rows(); x++){
+            if(f.row(static_cast<int>(x))[y0 / BitField::bits] != 0){
+                zero = false;
+                break;
+            }
+        }
+        if(zero) return empty_node(level);
+    }
+    const long long h = size / 2;
+    const Index nw = build(f, level - 1, x0, y0);
+    const Index ne = build(f, level - 1, x0, y0 + h);
+    const Index sw = build(f, level - 1, x0 + h, y0);
+    const Index se = build(f, level - 1, x0 + h, y0 + h);
+    return join(nw, ne, sw, se);
+}
+
+/**
+ * @brief replace the pattern with the cells of a dense field
+ * @details fieldの(0, 0)を平面の原点に置く．
+ */
+inline void HashLife::load(const BitField &f){
+    int level = 3;
+    while((1LL << (level - 1)) < std::max(f.rows(), f.cols())) level++;
+    const long long h = 1LL << (level - 1);
+    root = build(f, level, -h, -h);
+    _generation = 0;
+}
+
+/**
+ * @brief copy cells of node n at (x0, y0) into the viewport whose origin is (vx, vy)
+ */
+inline void HashLife::draw(const Index n, BitField &f, const long long x0, const long long y0, const long long vx, const long long vy) const {
+    const Node a = nodes[n];
+    if(a.population == 0) return;
+    const long long size = 1LL << a.level;
+    if(x0 >= vx + f.rows() || y0 >= vy + f.cols() || x0 + size <= vx || y0 + size <= vy) return;
+    if(a.level == 0){
+        f.set(static_cast<int>(x0 - vx), static_cast<int>(y0 - vy), true);
+        return;
+    }
+    const long long h = size / 2;
+    draw(a.nw, f, x0, y0, vx, vy);
+    draw(a.ne, f, x0, y0 + h, vx, vy);
+    draw(a.sw, f, x0 + h, y0, vx, vy);
+    draw(a.se, f, x0 + h, y0 + h, vx, vy);
+}
+
+/**
+ * @brief pull the dense viewport [x0, x0+rows) × [y0, y0+cols) out into f
+ */
+inline void HashLife::draw(BitField &f, const long long x0, const long long y0) const {
+    f.clear();
+    const long long h = 1LL << (nodes[root].level - 1);
+    draw(root, f, -h, -h, x0, y0);
+}
+
+/**
+ * @brief mark nodes reachable from n
+ */
+inline void HashLife::mark(const Index n, std::vector<char> &marked) const {
+    if(marked[n]) return;
+    marked[n] = 1;
+    if(nodes[n].level == 0) return;
+    mark(nodes[n].nw, marked);
+    mark(nodes[n].ne, marked);
+    mark(nodes[n].sw, marked);
+    mark(nodes[n].se, marked);
+}
+
+/**
+ * @brief free nodes unreachable from the root and the empty nodes
+ * @details 残ったノードのRESULTも，捨てたノードを指していれば忘れる．
+ */
+inline void HashLife::gc(){
+    std::vector<char> marked(nodes.size(), 0);
+    mark(root, marked);
+    for(auto&& e : empty) mark(e, marked);
+    table.clear();
+    free_list.clear();
+    for(Index i = static_cast<Index>(nodes.size()); i-- > 2;){
+        Node &n = nodes[i];
+        if(!marked[i]){
+            n.result = none;
+            free_list.push_back(i);
+            continue;
+        }
+        if(n.result != none && !marked[n.result]) n.result = none;
+        table.emplace(Key{n.nw, n.ne, n.sw, n.se}, i);
+    }
+}
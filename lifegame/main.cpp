@@ -2,14 +2,60 @@
  * @file main.cpp
  * @brief Game of Life
  * @author yuto-te
+ * @details g++ -O3 -march=native -pthread main.cpp でビルドする．AVX2が使えるときはAVX2版のカーネルになる．
+ *          ./a.out -t 8 のようにスレッド数を指定できる(省略時はコア数)．
+ *          ./a.out -e hashlife -k 20 でHashLifeエンジンを使い，1回の更新で2^20世代進める．--nodes でノード数の上限を指定する．
+ *          ./a.out -e sparse で境界のない平面を64×64のチャンクに分けて，生きたセルのあるチャンクだけを計算する．
+ *          --rule B36/S23 のようにルールを指定する．"R2,C0,M1,S5..8,B5..6,NM"形式で半径2以上の近傍も使える(bitfieldのみ)．
+ *          ./a.out --ensemble 10000 --soup 16 --max-gen 20000 -o soups.bin のように，ランダムなスープを全コアで並列に計算し，
+ *          周期に入るまでの世代数，周期，個体数をスープごとにファイルに書き出す．
+ *          表示は --fps で1秒あたりのフレーム数の上限，--view x y で左上，--zoom z で縮小率，--glyph-width で1セルの桁数を指定する．
+ *          ./a.out --batch -L 4096 -n 1000 --seed 1 のように--batchを付けると，入力も表示もせずにn世代計算して，
+ *          世代/秒，セル更新/秒，個体数，最終状態のハッシュを出力する．-p でRLEかplaintextのパターンを中央に置いて始める．
  */
 
 #include <iostream>
 #include <ctime>        // time
-#include <cstdlib>      // srand,rand
 #include <string>
-#include <unistd.h>     // sleep
 #include <vector>
+#include <thread>       // hardware_concurrency
+#include <algorithm>    // min,max
+#include <memory>       // unique_ptr
+#include <random>       // mt19937
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <unordered_map>
+
+#include "bitfield.hpp"
+#include "rule.hpp"
+#include "thread_pool.hpp"
+#include "hashlife.hpp"
+#include "sparse_world.hpp"
+#include "pattern.hpp"
+#include "renderer.hpp"
+#include "ensemble.hpp"
+
+/**
+ * @brief engine which computes the next generations
+ * @details bitfieldはL×Lの外側をすべてdeadとして1世代ずつ計算する．
+ *          hashlifeは無限平面上で2^k世代ずつ飛ばして計算し，L×Lの範囲を表示する．
+ *          sparseは無限平面上で生きたセルのあるチャンクだけを1世代ずつ計算し，L×Lの範囲を表示する．
+ */
+enum class Engine{
+    bitfield,
+    hashlife,
+    sparse
+};
+
+/**
+ * @brief engine from its name, bitfield if unknown
+ */
+Engine engine_from_name(const std::string &name){
+    if(name == "hashlife") return Engine::hashlife;
+    else if(name == "sparse") return Engine::sparse;
+    else return Engine::bitfield;
+}
 
 /**
  * @brief class of life game field
@@ -17,107 +63,414 @@
 class LifeGame{
 private:
     const int _size;
-    std::vector< std::vector<bool> > field;
-    bool at_cell(const int &x, const int &y);
-    bool dead_or_alive(const int &x, const int &y);
+    BitField field, next;
+    int tile_rows, tile_words;  // 1タイルの行数とワード数
+    int tiles_x, tiles_y;       // タイルの個数
+    std::vector<char> changed, changed_next;    // 前の世代で変化したタイル
+    std::vector<int> worklist;  // 計算し直すタイル
+    const Rule rule;
+    const RowKernel kernel;
+    const std::vector<std::uint64_t> zero;  // 半径2以上のときの範囲外の行
+    ThreadPool pool;
+    const Engine engine;
+    std::unique_ptr<HashLife> hashlife;
+    std::unique_ptr<SparseWorld> world;
+    Renderer screen;
+    void update_tile(const int tile);
+    void sync();
 public:
-    LifeGame(const int L);
+    LifeGame(const int L, const int threads = 1, const Engine engine = Engine::bitfield, const std::size_t max_nodes = std::size_t(1) << 22,
+             const Rule &rule = Rule());
+    void randomize(const unsigned seed);
+    void soup(const std::uint64_t key, const int size);
+    void load(const Pattern &p);
     void update();
-    void print(const int t);
+    void jump(const int k);
+    void advance(const long long n);
+    void print(const long long t);
+    std::uint64_t population() const;
+    std::size_t chunks() const { return world ? world->chunks() : 0; }
+    Renderer &renderer(){ return screen; }
+    std::string rule_name() const { return rule.name(); }
+    std::uint64_t hash() const;
+    int tiles() const { return tiles_x * tiles_y; }
+    int active_tiles() const { return static_cast<int>(worklist.size()); }
 };
 
 /**
  * @brief initialize field
- * @param[in] L size of lattice
+ * @param[in] L size of lattice, threads number of threads for update, engine update engine, max_nodes node cache size of HashLife, rule rule
+ * @details タイルは入出力合わせて10KiB程度(L1に収まる大きさ)になるように，横512セル×縦64行を基本とする．
+ *          変化のないタイルを飛ばせるように，タイルはあまり大きくしない．最初の世代はすべてのタイルを計算する．
  */
-LifeGame::LifeGame(const int L)
+LifeGame::LifeGame(const int L, const int threads, const Engine engine, const std::size_t max_nodes, const Rule &rule)
     : _size(L)
+    , field(L, L)
+    , next(L, L)
+    , tile_rows(std::max(1, std::min(L, 64)))
+    , tile_words(std::min(field.words(), 8))
+    , tiles_x((L + tile_rows - 1) / tile_rows)
+    , tiles_y((field.words() + tile_words - 1) / tile_words)
+    , changed(tiles_x * tiles_y, 1)
+    , changed_next(tiles_x * tiles_y, 0)
+    , rule(rule)
+    , kernel(select_kernel(rule))
+    , zero(field.words() + 2, 0)
+    , pool(threads)
+    , engine(engine)
 {
-    const int threshold = 10;
-    field.resize(_size);
-    std::srand(time(NULL)); // seed of random number
+    if(engine == Engine::hashlife) hashlife.reset(new HashLife(max_nodes, rule));
+    if(engine == Engine::sparse) world.reset(new SparseWorld(rule));
+    randomize(time(NULL)); // seed of random number
+}
+
+/**
+ * @brief fill field with random cells
+ * @param[in] seed seed of random number
+ * @details 同じseedなら処理系によらず同じ初期状態になるようにmt19937を使う．aliveとdeadは半々．
+ */
+void LifeGame::randomize(const unsigned seed){
+    std::mt19937 rng(seed);
     for(int x = 0; x < _size; x++){
-        field[x].resize(_size);
         for(int y = 0; y < _size; y++){
-            if(rand() % (2*threshold) < threshold) field[x][y] = true;
-            else field[x][y] = false;
+            field.set(x, y, (rng() >> 31) & 1);
+        }
+    }
+    sync();
+}
+
+/**
+ * @brief clear field and put a random soup at the center
+ * @param[in] key key of the random number stream, size side of the soup
+ * @details 乱数はcounter_random(key, 行*ワード数 + ワード)で1ワード64セルずつ作る．aliveとdeadは半々．
+ */
+void LifeGame::soup(const std::uint64_t key, const int size){
+    field.clear();
+    const int s = std::min(size, _size);
+    const int x0 = (_size - s) / 2, y0 = (_size - s) / 2;
+    const int words = (s + BitField::bits - 1) / BitField::bits;
+    for(int x = 0; x < s; x++){
+        for(int i = 0; i < words; i++){
+            const std::uint64_t r = counter_random(key, static_cast<std::uint64_t>(x)*words + i);
+            for(int b = 0; b < BitField::bits && i*BitField::bits + b < s; b++){
+                if((r >> b) & 1) field.set(x0 + x, y0 + i*BitField::bits + b, true);
+            }
         }
     }
+    sync();
 }
 
 /**
- * @brief judge if the cell is dead or alive
- * @param[in] x field coordinate, y field coordinate
- * @param[out] bool cell condition
- * @details 範囲外参照を防ぐ．範囲外はすべてdead．
+ * @brief clear field and put a pattern at the center
+ * @param[in] p pattern
  */
-bool LifeGame::at_cell(const int &x, const int &y){
-    if(x < 0 || x >= _size || y < 0 || y >= _size) return false;
-    else return field[x][y];
+void LifeGame::load(const Pattern &p){
+    field.clear();
+    const int x0 = (_size - p.rows) / 2, y0 = (_size - p.cols) / 2;
+    for(auto&& cell : p.cells){
+        const int x = x0 + cell.first, y = y0 + cell.second;
+        if(x >= 0 && x < _size && y >= 0 && y < _size) field.set(x, y, true);
+    }
+    sync();
 }
 
 /**
- * @brief update cell to next time
- * @param[in] x field coordinate, y field coordinate
- * @param[out] bool if alive
- * @details 1つのセルについて，aliveかつ周囲8セルのうち2つまたは3つがaliveのとき次もalive．deadかつ周囲8セルのうち3つがaliveのとき次はalive．その他は次はdead．
+ * @brief notify engines that field was rewritten
+ * @details 全タイルを変化ありにして，hashlifeとsparseならfieldから作り直す．
  */
-bool LifeGame::dead_or_alive(const int &x, const int &y){
-    auto cell = at_cell(x, y);
-    auto count = at_cell(x - 1, y - 1) + at_cell(x    , y - 1) + at_cell(x + 1, y - 1)
-               + at_cell(x - 1, y    )                         + at_cell(x + 1, y    )
-               + at_cell(x - 1, y + 1) + at_cell(x    , y + 1) + at_cell(x + 1, y + 1);
-    if(count == 3) return true;
-    else if (cell && count == 2) return true;
-    else return false;
+void LifeGame::sync(){
+    std::fill(changed.begin(), changed.end(), 1);
+    if(engine == Engine::hashlife) hashlife->load(field);
+    if(engine == Engine::sparse) world->load(field);
+}
+
+/**
+ * @brief compute one tile of the next generation
+ * @param[in] tile tile number
+ * @details タイル内の各行を64セル単位でルールのカーネルに渡し，次の世代をnextに書く．fieldは読むだけなので，タイル同士は並列に計算できる．
+ *          半径2以上ならltl_rowsでタイルをまとめて計算する．今の世代と1ワードでも違えばchanged_nextに記録する．
+ */
+void LifeGame::update_tile(const int tile){
+    const int x0 = tile / tiles_y * tile_rows;
+    const int x1 = std::min(x0 + tile_rows, _size);
+    const int w0 = tile % tiles_y * tile_words;
+    const int n = std::min(tile_words, field.words() - w0);
+    const bool last = (w0 + n == field.words());
+    std::uint64_t diff = 0;
+    if(rule.radius > 1) ltl_rows(field, next, x0, x1, w0, n, rule, zero);
+    for(int x = x0; x < x1; x++){
+        std::uint64_t *out = next.row(x) + w0;
+        const std::uint64_t *in = field.row(x) + w0;
+        if(rule.radius == 1) kernel(field.row(x - 1) + w0, in, field.row(x + 1) + w0, out, n, rule.birth, rule.survive);
+        if(last) out[n - 1] &= field.tail_mask();
+        for(int i = 0; i < n; i++) diff |= out[i] ^ in[i];
+    }
+    changed_next[tile] = (diff != 0);
 }
 
 /**
  * @brief update field
+ * @details 前の世代で自分か周囲8タイルのどれかが変化したタイルだけをworklistに積み，スレッドプールで計算する．
+ *          全タイルを計算し終えてから(世代ごとのバリア)，fieldとnextを入れ替える．
+ *          飛ばしたタイルは前の世代から変化していないので，nextに残っている前の世代の値が次の世代の値と一致する．
  */
 void LifeGame::update(){
+    if(engine != Engine::bitfield){
+        advance(1);
+        return;
+    }
+    worklist.clear();
+    for(int i = 0; i < tiles_x; i++){
+        for(int j = 0; j < tiles_y; j++){
+            bool active = false;
+            for(int p = std::max(i - 1, 0); p <= std::min(i + 1, tiles_x - 1) && !active; p++){
+                for(int q = std::max(j - 1, 0); q <= std::min(j + 1, tiles_y - 1); q++){
+                    if(changed[p*tiles_y + q]){
+                        active = true;
+                        break;
+                    }
+                }
+            }
+            if(active) worklist.push_back(i*tiles_y + j);
+            else changed_next[i*tiles_y + j] = 0;
+        }
+    }
+    pool.run(active_tiles(), [this](const int i){ update_tile(worklist[i]); });
+    std::swap(changed, changed_next);
+    std::swap(field, next);
+}
+
+/**
+ * @brief update field by 2^k generations
+ * @param[in] k log2 of generations
+ * @details hashlifeなら1回のRESULTで進めてからL×Lの範囲をfieldに取り出す．それ以外は2^k世代を1世代ずつ進める．
+ */
+void LifeGame::jump(const int k){
+    if(engine == Engine::hashlife){
+        hashlife->step(k);
+        hashlife->draw(field, 0, 0);
+        return;
+    }
+    advance(1LL << k);
+}
+
+/**
+ * @brief update field by n generations
+ * @param[in] n generations
+ * @details hashlifeならnを2のべきに分けてRESULTで進める．hashlifeとsparseは最後にL×Lの範囲をfieldに取り出す．
+ */
+void LifeGame::advance(const long long n){
+    if(engine == Engine::hashlife){
+        hashlife->advance(n);
+        hashlife->draw(field, 0, 0);
+        return;
+    }
+    if(engine == Engine::sparse){
+        for(long long i = 0; i < n; i++) world->step(pool);
+        world->draw(field, 0, 0);
+        return;
+    }
+    for(long long i = 0; i < n; i++) update();
+}
+
+/**
+ * @brief number of alive cells
+ * @details hashlifeとsparseはL×Lの範囲の外も含めた平面全体の個数．
+ */
+std::uint64_t LifeGame::population() const {
+    if(engine == Engine::hashlife) return hashlife->population();
+    if(engine == Engine::sparse) return world->population();
+    return field.population();
+}
+
+/**
+ * @brief hash of the current state
+ * @details 各行のワードを順にFNV-1aで混ぜる．エンジンやスレッド数を変えても結果が変わらないことの確認に使う．
+ */
+std::uint64_t LifeGame::hash() const {
+    std::uint64_t h = 0xcbf29ce484222325ull;
     for(int x = 0; x < _size; x++){
-        for(int y = 0; y < _size; y++){
-            field[x][y] = dead_or_alive(x, y);
+        const std::uint64_t *row = field.row(x);
+        for(int i = 0; i < field.words(); i++){
+            h = (h ^ row[i])*0x100000001b3ull;
         }
     }
+    return h;
 }
 
 /**
  * @brief print life game on command prompt
  * @param[in] t time
+ * @details 前のフレームから変わったセルだけをRendererが書き換える．
  */
-void LifeGame::print(const int t){
-    std::system("clear");
-    std::cout << t << "[s]" << std::endl;
-    for(auto&& row : field){
-        for(auto&& cell : row){
-            std::cout << (cell ? "■" : "□");
-        }
-        std::cout << std::endl;
+void LifeGame::print(const long long t){
+    std::string header = std::to_string(t) + "[s]";
+    if(engine == Engine::bitfield) header += "  active tiles " + std::to_string(active_tiles()) + "/" + std::to_string(tiles());
+    screen.draw(field, header);
+}
+
+/**
+ * @brief run generations without input and rendering, and report speed and final state
+ * @param[in] game life game, generations number of generations
+ */
+void benchmark(LifeGame &game, const int L, const long long generations){
+    const auto start = std::chrono::steady_clock::now();
+    game.advance(generations);
+    const auto end = std::chrono::steady_clock::now();
+    const double sec = std::chrono::duration<double>(end - start).count();
+    std::cout << "rule " << game.rule_name() << std::endl;
+    std::cout << "size " << L << std::endl;
+    std::cout << "generations " << generations << std::endl;
+    std::cout << "seconds " << sec << std::endl;
+    std::cout << "generations/sec " << generations / sec << std::endl;
+    std::cout << "cell-updates/sec " << static_cast<double>(L)*L*generations / sec << std::endl;
+    std::cout << "population " << game.population() << std::endl;
+    if(game.chunks() > 0) std::cout << "chunks " << game.chunks() << std::endl;
+    std::cout << "hash " << std::hex << game.hash() << std::dec << std::endl;
+}
+
+/**
+ * @brief run random soups in parallel until each of them becomes periodic
+ * @param[in] L size of lattice, threads number of threads, rule rule, M number of soups, size side of soups,
+ *            max_gen maximum generations, seed seed, filename output file
+ * @details スープごとにLifeGameを1つ作り，1スレッドで計算する．スープの乱数はsoup_key(seed, 番号)の列なので，
+ *          スレッド数によらず同じ結果になる．毎世代の状態のハッシュを覚えておき，同じハッシュが出たら周期に入ったとして打ち切る．
+ */
+int ensemble(const int L, const int threads, const Rule &rule, const int M, const int size, const int max_gen,
+             const std::uint64_t seed, const std::string &filename){
+    SoupWriter writer(filename, L, size, max_gen, seed);
+    if(!writer.good()){
+        std::cerr << "cannot open " << filename << std::endl;
+        return 1;
     }
-    std::cout << std::endl;
+    std::atomic<long long> settled_total(0), population_total(0), settled_count(0);
+    ThreadPool pool(threads);
+    const auto start = std::chrono::steady_clock::now();
+    pool.run(M, [&](const int id){
+        LifeGame game(L, 1, Engine::bitfield, 0, rule);
+        game.soup(soup_key(seed, id), size);
+        std::unordered_map<std::uint64_t, int> seen;
+        SoupResult r = {static_cast<std::uint32_t>(id), 0, 0, 0};
+        seen.emplace(game.hash(), 0);
+        for(int gen = 1; gen <= max_gen; gen++){
+            game.update();
+            const auto it = seen.emplace(game.hash(), gen);
+            if(!it.second){
+                r.settled = it.first->second;
+                r.period = gen - it.first->second;
+                break;
+            }
+        }
+        r.population = static_cast<std::uint32_t>(game.population());
+        writer.write(r);
+        if(r.period != 0){
+            settled_total += r.settled;
+            settled_count++;
+        }
+        population_total += r.population;
+    });
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "rule " << rule.name() << std::endl;
+    std::cout << "soups " << M << std::endl;
+    std::cout << "settled " << settled_count << std::endl;
+    std::cout << "mean settled generation " << (settled_count > 0 ? static_cast<double>(settled_total) / settled_count : 0.) << std::endl;
+    std::cout << "mean final population " << static_cast<double>(population_total) / M << std::endl;
+    std::cout << "soups/sec " << M / sec << std::endl;
+    return 0;
 }
 
 /**
  * @brief main function
  */
-int main()
+int main(int argc, char *argv[])
 {
-    int L; // size of lattice
-    int TIME_MAX; // time of end
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    Engine engine = Engine::bitfield;
+    int k = 0; // 1回の更新で2^k世代進める
+    std::size_t max_nodes = std::size_t(1) << 22;
+    bool batch = false;
+    int L = 0; // size of lattice
+    long long generations = 1000;
+    unsigned seed = 1;
+    std::string pattern_file;
+    double fps = 1.;
+    long long view_x = 0, view_y = 0;
+    int zoom = 1, glyph_width = 2;
+    std::string rule_text;
+    int soups = 0, soup_size = 16, max_gen = 10000;
+    std::string output = "soups.bin";
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if((arg == "-t" || arg == "--threads") && i + 1 < argc) threads = std::stoi(argv[++i]);
+        else if((arg == "-e" || arg == "--engine") && i + 1 < argc) engine = engine_from_name(argv[++i]);
+        else if(arg == "-k" && i + 1 < argc) k = std::stoi(argv[++i]);
+        else if(arg == "--nodes" && i + 1 < argc) max_nodes = std::stoull(argv[++i]);
+        else if(arg == "--batch") batch = true;
+        else if((arg == "-L" || arg == "--size") && i + 1 < argc) L = std::stoi(argv[++i]);
+        else if((arg == "-n" || arg == "--generations") && i + 1 < argc) generations = std::stoll(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc) seed = std::stoul(argv[++i]);
+        else if((arg == "-p" || arg == "--pattern") && i + 1 < argc) pattern_file = argv[++i];
+        else if(arg == "--rule" && i + 1 < argc) rule_text = argv[++i];
+        else if(arg == "--ensemble" && i + 1 < argc) soups = std::stoi(argv[++i]);
+        else if(arg == "--soup" && i + 1 < argc) soup_size = std::stoi(argv[++i]);
+        else if(arg == "--max-gen" && i + 1 < argc) max_gen = std::stoi(argv[++i]);
+        else if(arg == "-o" && i + 1 < argc) output = argv[++i];
+        else if(arg == "--fps" && i + 1 < argc) fps = std::stod(argv[++i]);
+        else if(arg == "--view" && i + 2 < argc){
+            view_x = std::stoll(argv[++i]);
+            view_y = std::stoll(argv[++i]);
+        }
+        else if(arg == "--zoom" && i + 1 < argc) zoom = std::stoi(argv[++i]);
+        else if(arg == "--glyph-width" && i + 1 < argc) glyph_width = std::stoi(argv[++i]);
+    }
+
+    Pattern pattern;
+    if(!pattern_file.empty() && !read_pattern(pattern_file, pattern)){
+        std::cerr << "cannot read " << pattern_file << std::endl;
+        return 1;
+    }
+    // --ruleがなければパターンのルール，それもなければB3/S23
+    if(rule_text.empty()) rule_text = pattern.rule;
+    Rule rule;
+    if(!rule_text.empty() && !parse_rule(rule_text, rule)){
+        std::cerr << "cannot parse rule " << rule_text << std::endl;
+        return 1;
+    }
+    if(engine != Engine::bitfield && (rule.radius > 1 || (rule.birth & 1))){
+        std::cerr << "rule " << rule.name() << " needs the bitfield engine" << std::endl;
+        return 1;
+    }
+
+    if(soups > 0){
+        return ensemble(L == 0 ? 64 : L, threads, rule, soups, soup_size, max_gen, seed, output);
+    }
+
+    if(batch){
+        if(L == 0) L = std::max(1024, std::max(pattern.rows, pattern.cols));
+        LifeGame game(L, threads, engine, max_nodes, rule);
+        if(pattern_file.empty()) game.randomize(seed);
+        else game.load(pattern);
+        benchmark(game, L, generations);
+        return 0;
+    }
+
+    long long TIME_MAX; // time of end
     std::cout << "lattice size?" << std::endl;
     std::cin >> L;
     std::cout << "end time?" << std::endl;
     std::cin >> TIME_MAX;
 
-    LifeGame game(L);
-    int t = 0;
+    LifeGame game(L, threads, engine, max_nodes, rule);
+    if(!pattern_file.empty()) game.load(pattern);
+    game.renderer().set_viewport(view_x, view_y, zoom);
+    game.renderer().set_glyph_width(glyph_width);
+    game.renderer().set_fps(fps);
+    long long t = 0;
     while(t <= TIME_MAX){
         game.print(t);
-        game.update();
-        t++;
-        usleep(1000000);
+        game.jump(k);
+        t += 1LL << k;
+        game.renderer().wait();
     }
     return 0;
 }
@@ -0,0 +1,145 @@
+/**
+ * @file pattern.hpp
+ * @brief reading RLE and plaintext patterns of Game of Life
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <cctype>       // isdigit,isspace
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>      // pair
+#include <vector>
+
+/**
+ * @brief alive cells of a pattern and its bounding box
+ * @details cellsは(行, 列)．RLEのyが行，xが列に対応する．
+ */
+struct Pattern{
+    int rows = 0;
+    int cols = 0;
+    std::vector< std::pair<int, int> > cells;
+    std::string rule;   // RLEのヘッダにあれば
+};
+
+constexpr int max_run_length = 1 << 24; // RLEの1つの個数の上限
+
+/**
+ * @brief read a pattern in RLE format
+ * @param[in] in input stream
+ * @param[out] p pattern
+ * @param[out] bool if succeeded
+ * @details #で始まる行は読み飛ばす．ヘッダ行"x = m, y = n, rule = ..."のあとに，<個数><タグ>の列が続く．
+ *          タグはbがdead，それ以外の英字がalive，$が改行，!が終わり．
+ *          ヘッダの数が読めないときや個数がmax_run_lengthを超えるときは失敗にする．
+ */
+inline bool read_rle(std::istream &in, Pattern &p){
+    p = Pattern();
+    std::string line;
+    bool header = false;
+    while(std::getline(in, line)){
+        if(line.empty() || line[0] == '#') continue;
+        // x = m, y = n
+        std::string s;
+        for(auto&& c : line) if(!std::isspace(static_cast<unsigned char>(c))) s += c;
+        if(s.compare(0, 2, "x=") != 0) return false;
+        const auto comma = s.find(",y=");
+        if(comma == std::string::npos) return false;
+        try{
+            p.cols = std::stoi(s.substr(2, comma - 2));
+            p.rows = std::stoi(s.substr(comma + 3));
+        }
+        catch(const std::exception&){
+            return false;
+        }
+        if(p.rows < 0 || p.cols < 0) return false;
+        const auto rule = line.find("rule");
+        if(rule != std::string::npos){
+            const auto eq = line.find('=', rule);
+            if(eq != std::string::npos) p.rule = line.substr(eq + 1);
+        }
+        header = true;
+        break;
+    }
+    if(!header) return false;
+    int x = 0, y = 0, count = 0;
+    char c;
+    while(in.get(c)){
+        if(std::isdigit(static_cast<unsigned char>(c))){
+            count = count*10 + (c - '0');
+            if(count > max_run_length) return false;
+            continue;
+        }
+        const int n = (count == 0 ? 1 : count);
+        count = 0;
+        if(c == '!') break;
+        else if(c == '$'){
+            x += n;
+            y = 0;
+        }
+        else if(c == 'b' || c == '.'){
+            y += n;
+        }
+        else if(std::isalpha(static_cast<unsigned char>(c))){
+            for(int i = 0; i < n; i++) p.cells.push_back({x, y++});
+        }
+    }
+    for(auto&& cell : p.cells){
+        if(cell.first >= p.rows) p.rows = cell.first + 1;
+        if(cell.second >= p.cols) p.cols = cell.second + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief read a pattern in plaintext (.cells) format
+ * @param[in] in input stream
+ * @param[out] p pattern
+ * @param[out] bool if succeeded
+ * @details !で始まる行はコメント．Oか*がalive，それ以外はdead．
+ */
+inline bool read_plaintext(std::istream &in, Pattern &p){
+    p = Pattern();
+    std::string line;
+    int x = 0;
+    while(std::getline(in, line)){
+        if(!line.empty() && line[0] == '!') continue;
+        for(int y = 0; y < static_cast<int>(line.size()); y++){
+            if(line[y] == 'O' || line[y] == '*'){
+                p.cells.push_back({x, y});
+                if(y >= p.cols) p.cols = y + 1;
+            }
+        }
+        x++;
+    }
+    p.rows = x;
+    return true;
+}
+
+/**
+ * @brief read a pattern file, RLE or plaintext
+ * @param[in] filename file name
+ * @param[out] p pattern
+ * @param[out] bool if succeeded
+ * @details 最初のコメントでない行が"x"で始まればRLE，そうでなければplaintextとして読む．
+ */
+inline bool read_pattern(const std::string &filename, Pattern &p){
+    std::ifstream file(filename);
+    if(!file) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+    std::istringstream in(text);
+    std::string line;
+    bool rle = false;
+    while(std::getline(in, line)){
+        if(line.empty() || line[0] == '#' || line[0] == '!') continue;
+        rle = (line[0] == 'x');
+        break;
+    }
+    std::istringstream body(text);
+    return rle ? read_rle(body, p) : read_plaintext(body, p);
+}
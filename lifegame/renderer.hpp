@@ -0,0 +1,135 @@
+/**
+ * @file renderer.hpp
+ * @brief terminal renderer which writes only changed cells
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>    // min,max
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>       // sleep_until
+#include <vector>
+#include <sys/ioctl.h>  // ioctl,winsize
+#include <unistd.h>     // STDOUT_FILENO
+
+#include "bitfield.hpp"
+
+/**
+ * @brief draw a viewport of the field with ANSI escape sequences
+ * @details 1フレームを1つの文字列に組み立ててから1回で書き出す．前のフレームと違う表示セルだけカーソルを動かして書き換え，
+ *          同じ行で続けて変わったセルはカーソル移動を1回にまとめる．最初のフレームと表示範囲が変わったときだけ画面全体を描く．
+ *          zoomがz>1のとき，z×zセルのうち1つでもaliveなら■にする．表示範囲の左上は負なら0にし，field外のセルは見ない．
+ *          ■□は端末によっては全角幅なので，1セルの桁数をglyph_widthで指定する．
+ */
+class Renderer{
+private:
+    long long x0, y0;   // 表示範囲の左上
+    int zoom;
+    int glyph_width;
+    double fps;
+    int rows, cols;     // 前のフレームの表示セル数
+    std::vector<char> prev;
+    std::string frame;
+    std::chrono::steady_clock::time_point next_frame;
+    void move(const int r, const int c);
+public:
+    Renderer();
+    void set_viewport(const long long x, const long long y, const int z){ x0 = std::max(0LL, x); y0 = std::max(0LL, y); zoom = std::max(1, z); }
+    void set_glyph_width(const int w){ glyph_width = std::max(1, w); }
+    void set_fps(const double f){ fps = f; }
+    void draw(const BitField &field, const std::string &header);
+    void wait();
+};
+
+inline Renderer::Renderer()
+    : x0(0)
+    , y0(0)
+    , zoom(1)
+    , glyph_width(2)
+    , fps(1.)
+    , rows(-1)
+    , cols(-1)
+    , next_frame(std::chrono::steady_clock::now())
+{
+}
+
+/**
+ * @brief append cursor movement to the 1-origin terminal position (r, c)
+ */
+inline void Renderer::move(const int r, const int c){
+    frame += "\x1b[";
+    frame += std::to_string(r);
+    frame += ';';
+    frame += std::to_string(c);
+    frame += 'H';
+}
+
+/**
+ * @brief write one frame
+ * @param[in] field field to draw, header first line
+ * @details 端末の大きさはioctlで取り，取れなければ表示範囲いっぱいに描く．1行目はheader，2行目からセル．
+ */
+inline void Renderer::draw(const BitField &field, const std::string &header){
+    int term_rows = 1 << 20, term_cols = 1 << 20;
+    winsize ws;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0){
+        term_rows = ws.ws_row;
+        term_cols = ws.ws_col;
+    }
+    const long long vx = std::max(0LL, (field.rows() - x0 + zoom - 1) / zoom);
+    const long long vy = std::max(0LL, (field.cols() - y0 + zoom - 1) / zoom);
+    const int r_max = static_cast<int>(std::min<long long>(vx, std::max(0, term_rows - 2)));
+    const int c_max = static_cast<int>(std::min<long long>(vy, term_cols / glyph_width));
+
+    frame.clear();
+    const bool full = (r_max != rows || c_max != cols);
+    if(full){
+        frame += "\x1b[2J";
+        rows = r_max;
+        cols = c_max;
+        prev.assign(static_cast<std::size_t>(rows)*cols, -1);
+    }
+    move(1, 1);
+    frame += header;
+    frame += "\x1b[K";
+
+    for(int i = 0; i < rows; i++){
+        int last = -2;  // 直前に書いた表示セル
+        for(int j = 0; j < cols; j++){
+            bool alive = false;
+            for(long long x = x0 + i*static_cast<long long>(zoom); x < std::min<long long>(x0 + (i + 1)*static_cast<long long>(zoom), field.rows()) && !alive; x++){
+                for(long long y = y0 + j*static_cast<long long>(zoom); y < std::min<long long>(y0 + (j + 1)*static_cast<long long>(zoom), field.cols()); y++){
+                    if(field.get(static_cast<int>(x), static_cast<int>(y))){
+                        alive = true;
+                        break;
+                    }
+                }
+            }
+            char &p = prev[static_cast<std::size_t>(i)*cols + j];
+            if(p == static_cast<char>(alive)) continue;
+            p = alive;
+            if(last != j - 1) move(i + 2, j*glyph_width + 1);
+            frame += (alive ? "■" : "□");
+            last = j;
+        }
+    }
+    move(rows + 2, 1);
+    std::cout.write(frame.data(), frame.size());
+    std::cout.flush();
+}
+
+/**
+ * @brief sleep until the next frame so that frames do not exceed fps
+ * @details fpsが0以下なら待たない．
+ */
+inline void Renderer::wait(){
+    if(fps <= 0.) return;
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1./fps));
+    next_frame += period;
+    const auto now = std::chrono::steady_clock::now();
+    if(next_frame < now) next_frame = now;
+    else std::this_thread::sleep_until(next_frame);
+}
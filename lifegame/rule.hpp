@@ -0,0 +1,395 @@
+/**
+ * @file rule.hpp
+ * @brief outer-totalistic rules of Life-like cellular automata and their kernels
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <cctype>       // isdigit,tolower
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bitfield.hpp"
+
+/**
+ * @brief birth and survival conditions
+ * @details radius == 1ならMoore近傍8セルで，birth/survive のビットnが立っていれば近傍n個で誕生/生存("B3/S23"形式)．
+ *          radius > 1ならLarger than Lifeで，(2r+1)^2の範囲の個数が[birth_lo, birth_hi]なら誕生，[survive_lo, survive_hi]なら生存．
+ *          middleがtrueなら中心のセルも数える("R2,C0,M1,S5..8,B5..6,NM"形式)．
+ */
+struct Rule{
+    int radius = 1;
+    std::uint32_t birth = 1u << 3;
+    std::uint32_t survive = (1u << 2) | (1u << 3);
+    bool middle = false;
+    int birth_lo = 0, birth_hi = -1;
+    int survive_lo = 0, survive_hi = -1;
+    std::string name() const;
+};
+
+/**
+ * @brief rule string in the same format as parsed
+ */
+inline std::string Rule::name() const {
+    std::ostringstream s;
+    if(radius == 1){
+        s << "B";
+        for(int n = 0; n <= 8; n++) if((birth >> n) & 1) s << n;
+        s << "/S";
+        for(int n = 0; n <= 8; n++) if((survive >> n) & 1) s << n;
+    }
+    else{
+        s << "R" << radius << ",C0,M" << middle << ",S" << survive_lo << ".." << survive_hi
+          << ",B" << birth_lo << ".." << birth_hi << ",NM";
+    }
+    return s.str();
+}
+
+/**
+ * @brief parse "B3/S23" or "R2,C0,M1,S5..8,B5..6,NM"
+ * @param[in] text rule string
+ * @param[out] rule rule
+ * @param[out] bool if succeeded
+ * @details 大文字小文字は区別しない．B/Sの順番は問わない．Larger than Lifeの半径は10まで．
+ */
+inline bool parse_rule(const std::string &text, Rule &rule){
+    std::string s;
+    for(auto&& c : text) if(!std::isspace(static_cast<unsigned char>(c))) s += std::tolower(static_cast<unsigned char>(c));
+    if(s.empty()) return false;
+    Rule r;
+    if(s[0] == 'r'){
+        // Larger than Life
+        std::stringstream in(s);
+        std::string token;
+        bool has_b = false, has_s = false;
+        auto range = [](const std::string &t, int &lo, int &hi){
+            const auto dots = t.find("..");
+            if(dots == std::string::npos) return false;
+            lo = std::stoi(t.substr(1, dots - 1));
+            hi = std::stoi(t.substr(dots + 2));
+            return true;
+        };
+        // 数が読めなければ失敗
+        try{
+            while(std::getline(in, token, ',')){
+                if(token.empty()) return false;
+                if(token[0] == 'r') r.radius = std::stoi(token.substr(1));
+                else if(token[0] == 'c'){
+                    const int states = std::stoi(token.substr(1));
+                    if(states != 0 && states != 2) return false;
+                }
+                else if(token[0] == 'm') r.middle = (token.substr(1) == "1");
+                else if(token[0] == 's') has_s = range(token, r.survive_lo, r.survive_hi);
+                else if(token[0] == 'b') has_b = range(token, r.birth_lo, r.birth_hi);
+                else if(token != "nm") return false;
+            }
+        }
+        catch(const std::exception&){
+            return false;
+        }
+        if(!has_b || !has_s || r.radius < 1 || r.radius > 10) return false;
+        if(r.radius == 1){
+            // 8近傍のビットマスクに直す
+            r.birth = r.survive = 0;
+            for(int n = 0; n <= 8; n++){
+                if(r.birth_lo <= n && n <= r.birth_hi) r.birth |= 1u << n;
+                const int m = n + (r.middle ? 1 : 0);
+                if(r.survive_lo <= m && m <= r.survive_hi) r.survive |= 1u << n;
+            }
+        }
+        rule = r;
+        return true;
+    }
+    r.birth = r.survive = 0;
+    std::uint32_t *target = nullptr;
+    bool has_b = false, has_s = false;
+    for(auto&& c : s){
+        if(c == 'b'){
+            target = &r.birth;
+            has_b = true;
+        }
+        else if(c == 's'){
+            target = &r.survive;
+            has_s = true;
+        }
+        else if(c == '/') continue;
+        else if(c >= '0' && c <= '8' && target != nullptr) *target |= 1u << (c - '0');
+        else return false;
+    }
+    if(!has_b || !has_s) return false;
+    rule = r;
+    return true;
+}
+
+/**
+ * @brief word whose all bits are b
+ */
+template<class T> inline T fill_word(const bool b);
+template<> inline std::uint64_t fill_word<std::uint64_t>(const bool b){ return b ? ~std::uint64_t(0) : 0; }
+#ifdef __AVX2__
+template<> inline __v4di fill_word<__v4di>(const bool b){ return (__v4di)_mm256_set1_epi64x(b ? -1 : 0); }
+#endif
+
+/**
+ * @brief bit-sliced number of alive neighbors, c0 + 2*c1 + 4*c2 + 8*c3
+ * @details life_wordと同じ全加算器の組み合わせで，2の位以上も個数として残す．
+ *          uint64_tと__m256i(__v4di)のどちらでも使えるように，GCC/Clangのベクトル型のビット演算子で書く．
+ */
+template<class T>
+inline void neighbor_count(const T uw, const T uc, const T ue, const T mw, const T me, const T dw, const T dc, const T de,
+                           T &c0, T &c1, T &c2, T &c3){
+    const T ut = uw ^ uc, us = ut ^ ue, u2 = (uw & uc) | (ut & ue);
+    const T dt = dw ^ dc, ds = dt ^ de, d2 = (dw & dc) | (dt & de);
+    const T ms = mw ^ me, m2 = mw & me;
+    const T ot = us ^ ms, o2 = (us & ms) | (ot & ds);
+    c0 = ot ^ ds;
+    // 2の位: u2 + d2 + m2 + o2
+    const T tt = u2 ^ d2, ts = tt ^ m2, t4 = (u2 & d2) | (tt & m2);
+    c1 = ts ^ o2;
+    const T t4b = ts & o2;
+    c2 = t4 ^ t4b;
+    c3 = t4 & t4b;
+}
+
+/**
+ * @brief bits where the count equals n
+ */
+template<class T>
+inline T count_equals(const T c0, const T c1, const T c2, const T c3, const int n){
+    return ((n & 1) ? c0 : ~c0) & ((n & 2) ? c1 : ~c1) & ((n & 4) ? c2 : ~c2) & ((n & 8) ? c3 : ~c3);
+}
+
+/**
+ * @brief rule fixed at compile time
+ * @details BとSは定数なので，ループを展開すると使わない個数の比較は消えて，ルールの判定はセルごとに残らない．
+ */
+template<std::uint32_t B, std::uint32_t S>
+struct FixedRule{
+    template<class T>
+    T operator()(const T mc, const T c0, const T c1, const T c2, const T c3) const {
+        T born = fill_word<T>(false), keep = fill_word<T>(false);
+        for(int n = 0; n <= 8; n++){
+            if((B >> n) & 1) born = born | count_equals(c0, c1, c2, c3, n);
+            if((S >> n) & 1) keep = keep | count_equals(c0, c1, c2, c3, n);
+        }
+        return (~mc & born) | (mc & keep);
+    }
+};
+
+/**
+ * @brief rule given at run time
+ * @details 個数ごとのマスク(全ビット0か1)を先に作っておき，ワードごとに分岐なしで選ぶ．
+ */
+template<class T>
+struct MaskRule{
+    T birth[9], survive[9];
+    MaskRule(const std::uint32_t b, const std::uint32_t s){
+        for(int n = 0; n <= 8; n++){
+            birth[n] = fill_word<T>((b >> n) & 1);
+            survive[n] = fill_word<T>((s >> n) & 1);
+        }
+    }
+    T operator()(const T mc, const T c0, const T c1, const T c2, const T c3) const {
+        T born = fill_word<T>(false), keep = fill_word<T>(false);
+        for(int n = 0; n <= 8; n++){
+            const T eq = count_equals(c0, c1, c2, c3, n);
+            born = born | (eq & birth[n]);
+            keep = keep | (eq & survive[n]);
+        }
+        return (~mc & born) | (mc & keep);
+    }
+};
+
+/**
+ * @brief compute one row of the next generation with a rule
+ * @details life_rowと同じくupとdownとmidの[-1]と[n]はパディングとして読む．
+ */
+template<class Scalar, class Vector>
+inline void rule_row(const std::uint64_t *up, const std::uint64_t *mid, const std::uint64_t *down,
+                     std::uint64_t *out, const int n, const Scalar &scalar, const Vector &vector){
+    int i = 0;
+#ifdef __AVX2__
+    for(; i + 4 <= n; i += 4){
+        __m256i uw, uc, ue, mw, mc, me, dw, dc, de, c0, c1, c2, c3;
+        shift_we(up + i, uw, uc, ue);
+        shift_we(mid + i, mw, mc, me);
+        shift_we(down + i, dw, dc, de);
+        neighbor_count(uw, uc, ue, mw, me, dw, dc, de, c0, c1, c2, c3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), vector(mc, c0, c1, c2, c3));
+    }
+#else
+    (void)vector;
+#endif
+    for(; i < n; i++){
+        const std::uint64_t uc = up[i], mc = mid[i], dc = down[i];
+        std::uint64_t c0, c1, c2, c3;
+        neighbor_count((uc << 1) | (up[i - 1] >> 63), uc, (uc >> 1) | (up[i + 1] << 63),
+                       (mc << 1) | (mid[i - 1] >> 63), (mc >> 1) | (mid[i + 1] << 63),
+                       (dc << 1) | (down[i - 1] >> 63), dc, (dc >> 1) | (down[i + 1] << 63),
+                       c0, c1, c2, c3);
+        out[i] = scalar(mc, c0, c1, c2, c3);
+    }
+}
+
+/**
+ * @brief kernel computing one row, the birth and survive masks are used only by the run-time kernel
+ */
+using RowKernel = void (*)(const std::uint64_t*, const std::uint64_t*, const std::uint64_t*, std::uint64_t*, const int,
+                           const std::uint32_t, const std::uint32_t);
+
+/**
+ * @brief kernel instantiated for B and S
+ */
+template<std::uint32_t B, std::uint32_t S>
+inline void fixed_kernel(const std::uint64_t *up, const std::uint64_t *mid, const std::uint64_t *down, std::uint64_t *out, const int n,
+                         const std::uint32_t, const std::uint32_t){
+    rule_row(up, mid, down, out, n, FixedRule<B, S>(), FixedRule<B, S>());
+}
+
+/**
+ * @brief B3/S23 kernel, which uses the shorter adder of life_row
+ */
+inline void life_kernel(const std::uint64_t *up, const std::uint64_t *mid, const std::uint64_t *down, std::uint64_t *out, const int n,
+                        const std::uint32_t, const std::uint32_t){
+    life_row(up, mid, down, out, n);
+}
+
+/**
+ * @brief kernel for rules which have no instantiation
+ */
+inline void mask_kernel(const std::uint64_t *up, const std::uint64_t *mid, const std::uint64_t *down, std::uint64_t *out, const int n,
+                        const std::uint32_t birth, const std::uint32_t survive){
+#ifdef __AVX2__
+    rule_row(up, mid, down, out, n, MaskRule<std::uint64_t>(birth, survive), MaskRule<__v4di>(birth, survive));
+#else
+    rule_row(up, mid, down, out, n, MaskRule<std::uint64_t>(birth, survive), 0);
+#endif
+}
+
+/**
+ * @brief bit mask of neighbor counts written as digits
+ */
+constexpr std::uint32_t counts(const char *digits){
+    return *digits == '\0' ? 0 : ((1u << (*digits - '0')) | counts(digits + 1));
+}
+
+/**
+ * @brief pre-instantiated kernel of the rule, or the run-time kernel
+ * @details よく使うルールはコンパイル時に特殊化したカーネルを使う．
+ */
+inline RowKernel select_kernel(const Rule &rule){
+    struct Entry{
+        std::uint32_t birth, survive;
+        RowKernel kernel;
+    };
+    static const Entry table[] = {
+        {counts("3"), counts("23"), life_kernel},                                                   // Life
+        {counts("36"), counts("23"), fixed_kernel<counts("36"), counts("23")>},                     // HighLife
+        {counts("2"), counts(""), fixed_kernel<counts("2"), counts("")>},                           // Seeds
+        {counts("3678"), counts("34678"), fixed_kernel<counts("3678"), counts("34678")>},           // Day & Night
+        {counts("34"), counts("34"), fixed_kernel<counts("34"), counts("34")>},                     // 34 Life
+        {counts("1357"), counts("1357"), fixed_kernel<counts("1357"), counts("1357")>},             // Replicator
+        {counts("368"), counts("245"), fixed_kernel<counts("368"), counts("245")>},                 // Morley
+        {counts("3"), counts("012345678"), fixed_kernel<counts("3"), counts("012345678")>},         // Life without Death
+        {counts("36"), counts("125"), fixed_kernel<counts("36"), counts("125")>},                   // 2x2
+        {counts("35678"), counts("5678"), fixed_kernel<counts("35678"), counts("5678")>},           // Diamoeba
+    };
+    for(auto&& e : table){
+        if(e.birth == rule.birth && e.survive == rule.survive) return e.kernel;
+    }
+    return mask_kernel;
+}
+
+/**
+ * @brief bit-sliced counter of up to 10 bits
+ */
+struct SlicedCount{
+    static constexpr int bits = 10;
+    std::uint64_t b[bits] = {};
+    void add1(std::uint64_t carry){
+        for(int j = 0; j < bits && carry; j++){
+            const std::uint64_t t = b[j] & carry;
+            b[j] ^= carry;
+            carry = t;
+        }
+    }
+    void add(const SlicedCount &o){
+        std::uint64_t carry = 0;
+        for(int j = 0; j < bits; j++){
+            const std::uint64_t x = b[j] ^ o.b[j];
+            const std::uint64_t c = (b[j] & o.b[j]) | (x & carry);
+            b[j] = x ^ carry;
+            carry = c;
+        }
+    }
+    void sub(const SlicedCount &o){
+        std::uint64_t borrow = 0;
+        for(int j = 0; j < bits; j++){
+            const std::uint64_t x = b[j] ^ o.b[j];
+            const std::uint64_t c = (~b[j] & o.b[j]) | (~x & borrow);
+            b[j] = x ^ borrow;
+            borrow = c;
+        }
+    }
+    /**
+     * @brief bits where the count is at least c
+     */
+    std::uint64_t at_least(const int c) const {
+        if(c <= 0) return ~std::uint64_t(0);
+        if(c >= (1 << bits)) return 0;
+        std::uint64_t borrow = 0;
+        for(int j = 0; j < bits; j++){
+            borrow = ((c >> j) & 1) ? (~b[j] | borrow) : (~b[j] & borrow);
+        }
+        return ~borrow;
+    }
+    std::uint64_t in_range(const int lo, const int hi) const {
+        return at_least(lo) & ~at_least(hi + 1);
+    }
+};
+
+/**
+ * @brief Larger than Life update of rows [x0, x1) and words [w0, w0+n)
+ * @param[in] in current field, rule rule with radius > 1, zero zero-filled row of in.words()+2 words
+ * @param[out] out next field
+ * @details ワードごとに横2r+1セルの個数を行ごとに求め，縦2r+1行分を足したり引いたりしながら下へずらしていく．
+ *          範囲の外の行はzeroを読む．
+ */
+inline void ltl_rows(const BitField &in, BitField &out, const int x0, const int x1, const int w0, const int n,
+                     const Rule &rule, const std::vector<std::uint64_t> &zero){
+    const int r = rule.radius;
+    auto row = [&](const int x){ return (x < -1 || x > in.rows()) ? zero.data() + 1 : in.row(x); };
+    auto horizontal = [&](const int x, const int i){
+        const std::uint64_t *p = row(x);
+        const std::uint64_t w = p[i - 1], c = p[i], e = p[i + 1];
+        SlicedCount h;
+        h.add1(c);
+        for(int s = 1; s <= r; s++){
+            h.add1((c >> s) | (e << (64 - s)));
+            h.add1((c << s) | (w >> (64 - s)));
+        }
+        return h;
+    };
+    // 中心を数えないときは，生存の判定だけ中心の分ずらす
+    const int s_lo = rule.survive_lo + (rule.middle ? 0 : 1), s_hi = rule.survive_hi + (rule.middle ? 0 : 1);
+    std::vector<SlicedCount> ring(2*r + 1);
+    for(int i = w0; i < w0 + n; i++){
+        SlicedCount v;
+        for(int x = x0 - r; x < x0 + r; x++){
+            ring[(x - x0 + r) % (2*r + 1)] = horizontal(x, i);
+            v.add(ring[(x - x0 + r) % (2*r + 1)]);
+        }
+        for(int x = x0; x < x1; x++){
+            SlicedCount &h = ring[(x + 2*r - x0) % (2*r + 1)];
+            h = horizontal(x + r, i);
+            v.add(h);
+            const std::uint64_t c = in.row(x)[i];
+            out.row(x)[i] = (~c & v.in_range(rule.birth_lo, rule.birth_hi)) | (c & v.in_range(s_lo, s_hi));
+            v.sub(ring[(x - x0) % (2*r + 1)]);
+        }
+    }
+}
@@ -0,0 +1,308 @@
+/**
+ * @file sparse_world.hpp
+ * @brief unbounded plane of Game of Life made of sparse chunks
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>    // remove_if
+#include <cstdint>
+#include <cstddef>      // size_t
+#include <cstring>      // memcpy,memset
+#include <functional>   // less
+#include <map>
+#include <memory>       // unique_ptr
+#include <unordered_map>
+#include <utility>      // pair
+#include <vector>
+
+#include "bitfield.hpp"
+#include "rule.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @brief 64×64 cells of the plane
+ * @details 1行を1ワードで持つ．yが小さいセルほど下位ビットなのはBitFieldと同じ．
+ */
+struct Chunk{
+    static constexpr int size = 64;
+    long long cx, cy;   // チャンクの座標(セルの座標を64で割ったもの)
+    std::uint64_t rows[size];
+    std::uint64_t next[size];
+};
+
+/**
+ * @brief pool of chunks to avoid calling the allocator every generation
+ * @details まとめて確保したブロックから切り出し，返されたチャンクはフリーリストで使い回す．
+ *          trimで全部のチャンクが空いたブロックを解放する(1ブロックぶんは残す)ので，確保したままのメモリは今使っているチャンクの数に従う．
+ */
+class ChunkPool{
+private:
+    static constexpr std::size_t block = 256;
+    struct Block{
+        std::unique_ptr<Chunk[]> chunks;
+        std::size_t used = 0;
+    };
+    std::map<const Chunk*, Block> blocks;   // 先頭のチャンク → ブロック
+    std::vector<Chunk*> free_list;
+    std::map<const Chunk*, Block>::iterator owner(const Chunk *c);
+public:
+    Chunk *acquire(const long long cx, const long long cy);
+    void release(Chunk *c);
+    void trim();
+    std::size_t capacity() const { return blocks.size()*block; }
+};
+
+/**
+ * @brief block which c was carved from, or blocks.end()
+ */
+inline std::map<const Chunk*, ChunkPool::Block>::iterator ChunkPool::owner(const Chunk *c){
+    auto it = blocks.upper_bound(c);
+    if(it == blocks.begin()) return blocks.end();
+    --it;
+    return std::less<const Chunk*>()(c, it->first + block) ? it : blocks.end();
+}
+
+/**
+ * @brief zero-filled chunk at (cx, cy)
+ */
+inline Chunk *ChunkPool::acquire(const long long cx, const long long cy){
+    if(free_list.empty()){
+        Block b;
+        b.chunks.reset(new Chunk[block]);
+        Chunk *base = b.chunks.get();
+        blocks.emplace(base, std::move(b));
+        for(std::size_t i = block; i-- > 0;) free_list.push_back(base + i);
+    }
+    Chunk *c = free_list.back();
+    free_list.pop_back();
+    owner(c)->second.used++;
+    c->cx = cx;
+    c->cy = cy;
+    std::memset(c->rows, 0, sizeof(c->rows));
+    return c;
+}
+
+inline void ChunkPool::release(Chunk *c){
+    owner(c)->second.used--;
+    free_list.push_back(c);
+}
+
+/**
+ * @brief free blocks with no chunk in use, keeping one spare block
+ */
+inline void ChunkPool::trim(){
+    if(free_list.size() <= block) return;
+    bool spare = false, freed = false;
+    for(auto it = blocks.begin(); it != blocks.end();){
+        if(it->second.used == 0){
+            if(!spare) spare = true;
+            else{
+                it = blocks.erase(it);
+                freed = true;
+                continue;
+            }
+        }
+        ++it;
+    }
+    if(!freed) return;
+    free_list.erase(std::remove_if(free_list.begin(), free_list.end(), [this](const Chunk *c){ return owner(c) == blocks.end(); }), free_list.end());
+}
+
+/**
+ * @brief unbounded plane which keeps only chunks with alive cells
+ * @details 端に生きたセルがあるチャンクの隣には次の世代でセルが生まれうるので，計算の前に空のチャンクを用意する．
+ *          計算したあと空になったチャンクはプールに返し，使われなくなったブロックは解放する．メモリは生きたセルのあるチャンクの数にだけ比例する．
+ *          ルールは半径1でB0を含まないものに限る．
+ */
+class SparseWorld{
+private:
+    std::unordered_map<std::uint64_t, Chunk*> table;
+    ChunkPool pool;
+    const Rule rule;
+    const RowKernel kernel;
+    static std::uint64_t key(const long long cx, const long long cy){
+        return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32) | static_cast<std::uint32_t>(cy);
+    }
+    static long long floor_div(const long long a){
+        return a >= 0 ? a / Chunk::size : -((-a + Chunk::size - 1) / Chunk::size);
+    }
+    const Chunk *find(const long long cx, const long long cy) const;
+    Chunk *chunk(const long long cx, const long long cy);
+    void compute(Chunk *c) const;
+public:
+    explicit SparseWorld(const Rule &rule = Rule()) : rule(rule), kernel(select_kernel(rule)) {}
+    SparseWorld(const SparseWorld&) = delete;
+    SparseWorld &operator=(const SparseWorld&) = delete;
+    void clear();
+    void set(const long long x, const long long y, const bool alive);
+    bool get(const long long x, const long long y) const;
+    void load(const BitField &f);
+    void step(ThreadPool &threads);
+    void draw(BitField &f, const long long x0, const long long y0) const;
+    std::uint64_t population() const;
+    std::size_t chunks() const { return table.size(); }
+    std::size_t capacity() const { return pool.capacity(); }
+};
+
+/**
+ * @brief chunk at (cx, cy) or nullptr
+ */
+inline const Chunk *SparseWorld::find(const long long cx, const long long cy) const {
+    auto it = table.find(key(cx, cy));
+    return it == table.end() ? nullptr : it->second;
+}
+
+/**
+ * @brief chunk at (cx, cy), created if absent
+ */
+inline Chunk *SparseWorld::chunk(const long long cx, const long long cy){
+    Chunk *&c = table[key(cx, cy)];
+    if(c == nullptr) c = pool.acquire(cx, cy);
+    return c;
+}
+
+/**
+ * @brief kill all cells
+ */
+inline void SparseWorld::clear(){
+    for(auto&& kv : table) pool.release(kv.second);
+    table.clear();
+    pool.trim();
+}
+
+/**
+ * @brief write cell (x, y)
+ */
+inline void SparseWorld::set(const long long x, const long long y, const bool alive){
+    const long long cx = floor_div(x), cy = floor_div(y);
+    if(!alive && find(cx, cy) == nullptr) return;
+    std::uint64_t &w = chunk(cx, cy)->rows[x - cx*Chunk::size];
+    const std::uint64_t b = std::uint64_t(1) << (y - cy*Chunk::size);
+    if(alive) w |= b;
+    else w &= ~b;
+}
+
+/**
+ * @brief read cell (x, y)
+ */
+inline bool SparseWorld::get(const long long x, const long long y) const {
+    const long long cx = floor_div(x), cy = floor_div(y);
+    const Chunk *c = find(cx, cy);
+    if(c == nullptr) return false;
+    return (c->rows[x - cx*Chunk::size] >> (y - cy*Chunk::size)) & 1;
+}
+
+/**
+ * @brief replace the plane with the cells of a dense field
+ * @details fieldの(0, 0)を平面の原点に置く．1ワードがちょうどチャンクの1行になる．
+ */
+inline void SparseWorld::load(const BitField &f){
+    clear();
+    for(int x = 0; x < f.rows(); x++){
+        const std::uint64_t *row = f.row(x);
+        for(int i = 0; i < f.words(); i++){
+            if(row[i] != 0) chunk(x / Chunk::size, i)->rows[x % Chunk::size] = row[i];
+        }
+    }
+}
+
+/**
+ * @brief compute the next generation of one chunk into its next
+ * @details 上下左右と斜めのチャンクから境界の行と列を借りて，66行×(西・中央・東)の3ワードを並べ，
+ *          中央のワードを幅1の行としてルールのカーネルに渡す．西と東のワードがパディングの位置になる．
+ */
+inline void SparseWorld::compute(Chunk *c) const {
+    constexpr int n = Chunk::size;
+    const Chunk *nw = find(c->cx - 1, c->cy - 1), *no = find(c->cx - 1, c->cy), *ne = find(c->cx - 1, c->cy + 1);
+    const Chunk *we = find(c->cx, c->cy - 1), *ea = find(c->cx, c->cy + 1);
+    const Chunk *sw = find(c->cx + 1, c->cy - 1), *so = find(c->cx + 1, c->cy), *se = find(c->cx + 1, c->cy + 1);
+    std::uint64_t buf[(n + 2)*3];
+    auto fill = [&](const int r, const Chunk *w, const Chunk *m, const Chunk *e, const int i){
+        buf[r*3] = w ? w->rows[i] : 0;
+        buf[r*3 + 1] = m ? m->rows[i] : 0;
+        buf[r*3 + 2] = e ? e->rows[i] : 0;
+    };
+    fill(0, nw, no, ne, n - 1);
+    for(int r = 0; r < n; r++) fill(r + 1, we, c, ea, r);
+    fill(n + 1, sw, so, se, 0);
+    for(int r = 1; r <= n; r++){
+        kernel(buf + (r - 1)*3 + 1, buf + r*3 + 1, buf + (r + 1)*3 + 1, c->next + r - 1, 1, rule.birth, rule.survive);
+    }
+}
+
+/**
+ * @brief advance one generation
+ * @param[in] threads thread pool for computing chunks
+ */
+inline void SparseWorld::step(ThreadPool &threads){
+    constexpr int n = Chunk::size;
+    // 端に生きたセルがあるチャンクの隣を用意する
+    std::vector< std::pair<long long, long long> > grow;
+    for(auto&& kv : table){
+        const Chunk *c = kv.second;
+        std::uint64_t left = 0, right = 0;
+        for(int r = 0; r < n; r++){
+            left |= c->rows[r] & 1;
+            right |= c->rows[r] >> 63;
+        }
+        const std::uint64_t top = c->rows[0], bottom = c->rows[n - 1];
+        if(top) grow.push_back({c->cx - 1, c->cy});
+        if(bottom) grow.push_back({c->cx + 1, c->cy});
+        if(left) grow.push_back({c->cx, c->cy - 1});
+        if(right) grow.push_back({c->cx, c->cy + 1});
+        if(top & 1) grow.push_back({c->cx - 1, c->cy - 1});
+        if(top >> 63) grow.push_back({c->cx - 1, c->cy + 1});
+        if(bottom & 1) grow.push_back({c->cx + 1, c->cy - 1});
+        if(bottom >> 63) grow.push_back({c->cx + 1, c->cy + 1});
+    }
+    for(auto&& g : grow) chunk(g.first, g.second);
+
+    // 次の世代を計算する．計算中はtableを書き換えないので並列に読める
+    std::vector<Chunk*> list;
+    list.reserve(table.size());
+    for(auto&& kv : table) list.push_back(kv.second);
+    threads.run(static_cast<int>(list.size()), [&](const int i){ compute(list[i]); });
+
+    // 入れ替えて，空になったチャンクはプールに返す
+    for(auto&& c : list){
+        std::memcpy(c->rows, c->next, sizeof(c->rows));
+        std::uint64_t any = 0;
+        for(int r = 0; r < n; r++) any |= c->rows[r];
+        if(any == 0){
+            table.erase(key(c->cx, c->cy));
+            pool.release(c);
+        }
+    }
+    pool.trim();
+}
+
+/**
+ * @brief pull the dense viewport [x0, x0+rows) × [y0, y0+cols) out into f
+ */
+inline void SparseWorld::draw(BitField &f, const long long x0, const long long y0) const {
+    f.clear();
+    for(auto&& kv : table){
+        const Chunk *c = kv.second;
+        for(int r = 0; r < Chunk::size; r++){
+            const long long x = c->cx*Chunk::size + r - x0;
+            if(x < 0 || x >= f.rows()) continue;
+            for(std::uint64_t w = c->rows[r]; w != 0; w &= w - 1){
+                const long long y = c->cy*Chunk::size + __builtin_ctzll(w) - y0;
+                if(y >= 0 && y < f.cols()) f.set(static_cast<int>(x), static_cast<int>(y), true);
+            }
+        }
+    }
+}
+
+/**
+ * @brief number of alive cells
+ */
+inline std::uint64_t SparseWorld::population() const {
+    std::uint64_t p = 0;
+    for(auto&& kv : table){
+        for(auto&& w : kv.second->rows) p += __builtin_popcountll(w);
+    }
+    return p;
+}
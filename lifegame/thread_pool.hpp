@@ -0,0 +1,156 @@
+/**
+ * @file thread_pool.hpp
+ * @brief work-stealing thread pool for per-generation jobs
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief fixed set of threads that run a batch of indexed tasks and wait for all of them
+ * @details run()を呼ぶたびにタスク番号をスレッドごとのキューに連続した塊で配り，
+ *          自分のキューが空になったスレッドは他のキューの後ろから盗む．
+ *          run()は全タスクが終わるまで戻らないので，1世代に1回呼べばそのまま世代ごとのバリアになる．
+ *          呼び出し側のスレッドも0番のワーカーとして働く．
+ */
+class ThreadPool{
+private:
+    struct Queue{
+        std::mutex m;
+        std::deque<int> tasks;
+    };
+    std::vector<std::thread> workers;
+    std::vector<Queue> queues;
+    const std::function<void(int)> *job;
+    std::atomic<int> pending;
+    std::mutex m;
+    std::condition_variable cv_start, cv_done;
+    unsigned long epoch;
+    bool stop;
+    bool pop(const int id, int &task);
+    bool steal(const int id, int &task);
+    void work(const int id);
+    void loop(const int id);
+public:
+    explicit ThreadPool(const int n);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+    int size() const { return static_cast<int>(queues.size()); }
+    void run(const int n_tasks, const std::function<void(int)> &f);
+};
+
+/**
+ * @brief start n - 1 worker threads
+ * @param[in] n number of threads including the caller, 1 if less than 1
+ */
+inline ThreadPool::ThreadPool(const int n)
+    : queues(n < 1 ? 1 : n)
+    , job(nullptr)
+    , pending(0)
+    , epoch(0)
+    , stop(false)
+{
+    for(int id = 1; id < size(); id++){
+        workers.emplace_back(&ThreadPool::loop, this, id);
+    }
+}
+
+inline ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+    }
+    cv_start.notify_all();
+    for(auto&& t : workers) t.join();
+}
+
+/**
+ * @brief take a task from the front of own queue
+ */
+inline bool ThreadPool::pop(const int id, int &task){
+    Queue &q = queues[id];
+    std::lock_guard<std::mutex> lock(q.m);
+    if(q.tasks.empty()) return false;
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+/**
+ * @brief take a task from the back of another queue
+ */
+inline bool ThreadPool::steal(const int id, int &task){
+    for(int k = 1; k < size(); k++){
+        Queue &q = queues[(id + k) % size()];
+        std::lock_guard<std::mutex> lock(q.m);
+        if(q.tasks.empty()) continue;
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief run tasks until every queue is empty
+ */
+inline void ThreadPool::work(const int id){
+    int task;
+    while(pop(id, task) || steal(id, task)){
+        (*job)(task);
+        if(pending.fetch_sub(1) == 1){
+            std::lock_guard<std::mutex> lock(m);
+            cv_done.notify_all();
+        }
+    }
+}
+
+/**
+ * @brief body of worker threads, wait for the next batch and work on it
+ */
+inline void ThreadPool::loop(const int id){
+    unsigned long seen = 0;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv_start.wait(lock, [&]{ return stop || epoch != seen; });
+            if(stop) return;
+            seen = epoch;
+        }
+        work(id);
+    }
+}
+
+/**
+ * @brief run f(0), ..., f(n_tasks - 1) on the pool and wait for all of them
+ * @param[in] n_tasks number of tasks, f task body
+ */
+inline void ThreadPool::run(const int n_tasks, const std::function<void(int)> &f){
+    if(n_tasks <= 0) return;
+    job = &f;
+    pending = n_tasks;
+    const int n = size();
+    for(int id = 0; id < n; id++){
+        std::lock_guard<std::mutex> lock(queues[id].m);
+        for(int task = static_cast<long>(n_tasks)*id/n; task < static_cast<long>(n_tasks)*(id + 1)/n; task++){
+            queues[id].tasks.push_back(task);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m);
+        epoch++;
+    }
+    cv_start.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock(m);
+    cv_done.wait(lock, [&]{ return pending == 0; });
+}
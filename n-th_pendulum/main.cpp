@@ -1,6 +1,10 @@
 /*
 n重振り子
-LU分解で運動方程式を解く
+運動方程式をarticulated-body法(再帰的な方法)でO(N)で解く
+./a.out --config pendulum.conf で質量，腕の長さ，初期条件，時間パラメータを設定ファイルから読む
+おもりが8個以下なら固定長のベクトル，それより多ければ可変長のベクトルで計算する
+./a.out --lu でLU分解で解く(O(N^3))
+./a.out --bench で1ステップあたりの時間をおもりの数を変えて両方の方法で測る
 RK4
 */
 
@@ -8,131 +12,303 @@ RK4
 #include<Eigen/Core>
 #include<Eigen/LU>
 
+#include "../ode/rk4.hpp"
+
 using std::sin;
 using std::cos;
 
-// おもりの数
-constexpr int N = 5;
+// 固定長のベクトルを使うおもりの数の上限
+constexpr int max_fixed = 8;
 
 // 重力加速度
 constexpr double g = 9.80665;
 
-// 時間パラメータ
-constexpr double tlim = 100;
-constexpr double dt = 0.01;
-
-// 質量と振り子の腕の長さ
-using Mass = Eigen::Matrix<double, N, 1>;
-using Length = Eigen::Matrix<double, N, 1>;
+// 設定
+// 設定ファイルは"名前 = 値"の行を並べる．#から行末まではコメント．
+// mass, length, theta, dthetaはおもりの数だけ空白区切りで並べる(dthetaは省略すると0)．角度はラジアン．
+struct Config
+{
+    std::vector<double> mass, length, theta, dtheta;
+    double tlim = 100.;
+    double dt = 0.01;
+    int frame = 10;     // 何ステップごとにgifの1コマにするか
+};
 
 // 振り子の角度と角速度
-struct Condition
+// 前半Size成分が角度，後半Size成分が角速度
+template<int Size>
+using Condition = Eigen::Matrix<double, Size == Eigen::Dynamic ? Eigen::Dynamic : 2*Size, 1>;
+
+// おもりSize個の振り子
+// i番目のおもりはi-1番目のおもり(0番目は原点)と長さl(i)の質量のない棒でつながる
+// 角度は鉛直下向きから測る
+template<int Size>
+class Pendulum
 {
-    Eigen::Matrix<double, N, 1> theta;
-    Eigen::Matrix<double, N, 1> dtheta;
+public:
+    using Vector = Eigen::Matrix<double, Size, 1>;
+private:
+    Vector m, l;
+    Vector M;   // i番目から先の質量の和
+    // articulated-body法の作業領域
+    Vector Itx, Ity, tIt, tw;
+    // LU分解の作業領域
+    Eigen::Matrix<double, Size, Size> A;
+    Vector b, ddtheta;
+    Eigen::FullPivLU<Eigen::Matrix<double, Size, Size> > LU;
+public:
+    Pendulum(const Vector &m, const Vector &l);
+    int size() const { return static_cast<int>(m.size()); }
+    void updateLU(const Condition<Size> &cond, Condition<Size> &dcond);
+    void updateRecursive(const Condition<Size> &cond, Condition<Size> &dcond);
 };
 
-Condition operator*(const double x, const Condition cond){
-    Condition cond_return = {x*cond.theta, x*cond.dtheta};
-    return cond_return;
+template<int Size>
+Pendulum<Size>::Pendulum(const Vector &m, const Vector &l)
+    : m(m), l(l), M(m), Itx(m), Ity(m), tIt(m), tw(m), A(m.size(), m.size()), b(m), ddtheta(m), LU(m.size(), m.size())
+{
+    for(int i = size() - 2; i >= 0; i--) M(i) += M(i + 1);
 }
 
-Condition operator+(const Condition c1, const Condition c2){
-    Condition c_return = {c1.theta + c2.theta, c1.dtheta + c2.dtheta};
-    return c_return;
+// 運動方程式をLU分解で解く
+// sum_j M(max(i, j)) l(j) (cos(θi - θj) ddθj + sin(θi - θj) dθj^2) + M(i) g sin(θi) = 0
+template<int Size>
+void Pendulum<Size>::updateLU(const Condition<Size> &cond, Condition<Size> &dcond){
+    const int n = size();
+    const auto theta = cond.head(n);
+    const auto dtheta = cond.tail(n);
+    for(int i = 0; i < n; i++){
+        double tmp = -M(i)*g*sin(theta(i));
+        for(int j = 0; j < n; j++){
+            const double Mij = M(std::max(i, j));
+            A(i, j) = Mij*l(j)*cos(theta(i) - theta(j));
+            if(j != i) tmp -= Mij*l(j)*dtheta(j)*dtheta(j)*sin(theta(i) - theta(j));
+        };
+        b(i) = tmp;
+    };
+    LU.compute(A);
+    // LU.solve(b)は可変長のとき一時領域を確保するので，A = P^-1 L U Q^-1を作業領域の上で解く
+    ddtheta.noalias() = LU.permutationP()*b;
+    LU.matrixLU().template triangularView<Eigen::UnitLower>().solveInPlace(ddtheta);
+    LU.matrixLU().template triangularView<Eigen::Upper>().solveInPlace(ddtheta);
+    b.noalias() = LU.permutationQ()*ddtheta;
+    dcond.head(n) = dtheta;
+    dcond.tail(n) = b;
 }
 
-void initialCondition(Mass &m, Length &l, Condition &cond){
-    // 振り子の質量と腕の長さを与える
-    for(int i = 0; i < N; i++){
-        m(i,0) = (i + 1) * 0.5;
-        l(i,0) = (i + 1) * 0.5;
-    };
-    // 初期条件
-    for(int i = 0; i < N; i++){
-        cond.theta(i,0) = M_PI / 2.;
-        cond.dtheta(i,0) = 0.;
-    };
+// 運動方程式をarticulated-body法で解く
+// 棒は質量がなく両端がピンなので，棒iがおもりiに及ぼす力F(i)は棒の向きe(i) = (sinθi, -cosθi)に平行．
+// 先端から根元へ，おもりi以降が受ける力をF(i) = I(i) a(i) + z(i)(Iは2x2の対称行列)の形にまとめ，
+// t(i) = (cosθi, sinθi)としてt(i)・F(i) = 0からI, zを1つ根元側へ送る．
+// 根元から先端へ，a(i) = a(i-1) + l(i) ddθi t(i) - l(i) dθi^2 e(i)を代入してddθiを順に求める．
+template<int Size>
+void Pendulum<Size>::updateRecursive(const Condition<Size> &cond, Condition<Size> &dcond){
+    const int n = size();
+    const auto theta = cond.head(n);
+    const auto dtheta = cond.tail(n);
+    // 先端から: 1つ先から送られてきたI, z
+    double Pxx = 0., Pxy = 0., Pyy = 0., px = 0., py = 0.;
+    for(int i = n - 1; i >= 0; i--){
+        const double s = sin(theta(i)), c = cos(theta(i));
+        const double Ixx = m(i) + Pxx, Ixy = Pxy, Iyy = m(i) + Pyy;
+        // 遠心加速度 -l dθ^2 e と重力を含めた z + I(-l dθ^2 e)
+        const double w = -l(i)*dtheta(i)*dtheta(i);
+        const double wx = px + (Ixx*s - Ixy*c)*w;
+        const double wy = py + m(i)*g + (Ixy*s - Iyy*c)*w;
+        Itx(i) = Ixx*c + Ixy*s;
+        Ity(i) = Ixy*c + Iyy*s;
+        tIt(i) = c*Itx(i) + s*Ity(i);
+        tw(i) = c*wx + s*wy;
+        Pxx = Ixx - Itx(i)*Itx(i)/tIt(i);
+        Pxy = Ixy - Itx(i)*Ity(i)/tIt(i);
+        Pyy = Iyy - Ity(i)*Ity(i)/tIt(i);
+        px = wx - Itx(i)*tw(i)/tIt(i);
+        py = wy - Ity(i)*tw(i)/tIt(i);
+    }
+    // 根元から
+    double ax = 0., ay = 0.;
+    dcond.head(n) = dtheta;
+    for(int i = 0; i < n; i++){
+        const double s = sin(theta(i)), c = cos(theta(i));
+        const double ddtheta = -(Itx(i)*ax + Ity(i)*ay + tw(i))/(l(i)*tIt(i));
+        const double w = l(i)*dtheta(i)*dtheta(i);
+        ax += l(i)*ddtheta*c - w*s;
+        ay += l(i)*ddtheta*s + w*c;
+        dcond(n + i) = ddtheta;
+    }
 }
 
-double sum(const Eigen::Matrix<double, N, 1> x, const int m, const int n){
-    double total = 0.;
-    for(int i = m; i < n; i++){
-        total += x(i,0);
-    };
-    return total;
+// 設定しないときの振り子
+Config defaultConfig(const int n){
+    Config config;
+    for(int i = 0; i < n; i++){
+        config.mass.push_back((i + 1) * 0.5);
+        config.length.push_back((i + 1) * 0.5);
+        config.theta.push_back(M_PI / 2.);
+        config.dtheta.push_back(0.);
+    }
+    return config;
 }
 
-// 運動方程式
-Condition updateCondition(Mass m, Length l, Condition cond){
-    Eigen::Matrix<double, N, N> A;
-    Eigen::Matrix<double, N, 1> b, x;
-    for(int i = 0; i < N; i++){
-        double tmp = 0.;
-        for(int j = 0; j < N; j++){
-            if(j < i){
-                A(i, j) = sum(m, i, N)*l(j, 0)*cos(cond.theta(i, 0) - cond.theta(j, 0));
-                tmp -= sum(m, i, N)*l(j, 0)*cond.dtheta(j, 0)*cond.dtheta(j, 0)*sin(cond.theta(i, 0) - cond.theta(j, 0));
-            }
-            else if(j == i){
-                A(i, j) = sum(m, i, N)*l(i, 0);
-                tmp -= sum(m, i, N)*g*sin(cond.theta(i));
-            }
-            else{
-                A(i, j) = sum(m, j, N)*l(j, 0)*cos(cond.theta(i, 0) - cond.theta(j, 0));
-                tmp -= sum(m, i, N)*l(j, 0)*cond.dtheta(i, 0)*cond.dtheta(i, 0)*sin(cond.theta(i, 0) - cond.theta(j, 0));
-            }
-        };
-        b(i, 0) = tmp;
-    };
-    Eigen::FullPivLU<Eigen::Matrix<double, N, N> > LU(A);
-    return Condition{
-        cond.dtheta,
-        LU.solve(b)
+// 設定ファイルを読む
+bool readConfig(const std::string &filename, Config &config){
+    std::ifstream file(filename);
+    if(!file) return false;
+    config = Config();
+    std::string line;
+    while(std::getline(file, line)){
+        line = line.substr(0, line.find('#'));
+        const auto eq = line.find('=');
+        if(eq == std::string::npos) continue;
+        std::istringstream key_in(line.substr(0, eq)), in(line.substr(eq + 1));
+        std::string key;
+        key_in >> key;
+        std::vector<double> values;
+        for(double v; in >> v;) values.push_back(v);
+        if(values.empty() || !in.eof()) return false;    // 数でないものが混ざっていたら読めなかったことにする
+        if(key == "mass") config.mass = values;
+        else if(key == "length") config.length = values;
+        else if(key == "theta") config.theta = values;
+        else if(key == "dtheta") config.dtheta = values;
+        else if(key == "tlim") config.tlim = values[0];
+        else if(key == "dt") config.dt = values[0];
+        else if(key == "frame") config.frame = std::max(1, static_cast<int>(values[0]));
+        else return false;
+    }
+    const std::size_t n = config.mass.size();
+    if(config.dtheta.empty()) config.dtheta.assign(n, 0.);
+    const auto positive = [](const double v){ return v > 0.; };
+    if(!std::all_of(config.mass.begin(), config.mass.end(), positive) || !std::all_of(config.length.begin(), config.length.end(), positive)) return false;
+    return n > 0 && config.length.size() == n && config.theta.size() == n && config.dtheta.size() == n && config.dt > 0.;
+}
+
+// 設定から質量，腕の長さ，初期条件を作る
+template<int Size>
+void initialCondition(const Config &config, typename Pendulum<Size>::Vector &m, typename Pendulum<Size>::Vector &l, Condition<Size> &cond){
+    const int n = static_cast<int>(config.mass.size());
+    m.resize(n);
+    l.resize(n);
+    cond.resize(2*n);
+    for(int i = 0; i < n; i++){
+        m(i,0) = config.mass[i];
+        l(i,0) = config.length[i];
+        cond(i,0) = config.theta[i];
+        cond(n + i,0) = config.dtheta[i];
     };
 }
 
-void plot(FILE *gp, const Condition cond, const Length l){
+template<int Size>
+void plot(FILE *gp, const Condition<Size> &cond, const typename Pendulum<Size>::Vector &l){
     fprintf(gp, "plot '-' w lp lw 3\n");
     fprintf(gp, "0.0 0.0\n");
     double x = 0, y = 0;
-    for(int i = 0; i < N; i++){
-        x += l(i,0)*sin(cond.theta(i,0));
-        y -= l(i,0)*cos(cond.theta(i,0));
+    for(int i = 0; i < l.size(); i++){
+        x += l(i,0)*sin(cond(i,0));
+        y -= l(i,0)*cos(cond(i,0));
         fprintf(gp, "%f %f\n", x, y);
     }
     fprintf(gp, "e\n");
 
 }
 
-int main(){
-    Condition x;
-    Mass m;
-    Length l;
-    Condition k1, k2, k3, k4;
+// おもりの数を変えて1ステップ(RK4)の時間を測る
+// 両方の方法で同じ初期条件から4ステップ進めた状態の差も表示する
+void bench(){
+    using Vector = Pendulum<Eigen::Dynamic>::Vector;
+    using State = Condition<Eigen::Dynamic>;
+    std::printf("%6s %14s %14s %12s\n", "N", "recursive[us]", "LU[us]", "max|diff|");
+    for(int n = 2; n <= 4096; n *= 2){
+        const Config config = defaultConfig(n);
+        const double dt = config.dt;
+        Vector m, l;
+        State x0;
+        initialCondition<Eigen::Dynamic>(config, m, l, x0);
+        Pendulum<Eigen::Dynamic> pendulum(m, l);
+        ode::RK4<State> rk4(x0);
+        auto recursive = [&pendulum](const State &c, State &d, double){ pendulum.updateRecursive(c, d); };
+        auto lu = [&pendulum](const State &c, State &d, double){ pendulum.updateLU(c, d); };
+        // 1ステップあたりの時間(マイクロ秒)
+        auto measure = [&](auto &&f, const long long steps){
+            State x = x0;
+            const auto start = std::chrono::steady_clock::now();
+            for(long long i = 0; i < steps; i++) rk4.step(f, x, i*dt, dt);
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()/steps;
+        };
+        const double t_recursive = measure(recursive, std::max(16, 1000000/n));
+        if(n > 512){
+            std::printf("%6d %14.2f %14s %12s\n", n, t_recursive, "-", "-");
+            continue;
+        }
+        const double t_lu = measure(lu, std::max(4, 1000000/(n*n)));
+        State x1 = x0, x2 = x0;
+        for(int i = 0; i < 4; i++){
+            rk4.step(recursive, x1, i*dt, dt);
+            rk4.step(lu, x2, i*dt, dt);
+        }
+        std::printf("%6d %14.2f %14.2f %12.3e\n", n, t_recursive, t_lu, (x1 - x2).cwiseAbs().maxCoeff());
+    }
+}
+
+// 振り子を動かしてgifを作る
+// Sizeはおもりの数(Eigen::Dynamicなら可変長)．状態量と作業領域は最初に確保し，ステップごとには確保しない．
+template<int Size>
+void simulate(const Config &config, const bool lu){
+    Condition<Size> x;
+    typename Pendulum<Size>::Vector m, l;
     double t = 0.;
 
-    initialCondition(m, l, x);
+    initialCondition<Size>(config, m, l, x);
+    Pendulum<Size> pendulum(m, l);
+    ode::RK4<Condition<Size> > rk4(x);
+    auto f = [&pendulum, lu](const Condition<Size> &cond, Condition<Size> &dcond, double){
+        if(lu) pendulum.updateLU(cond, dcond);
+        else pendulum.updateRecursive(cond, dcond);
+    };
 
     FILE *gp = popen("gnuplot","w");
     fprintf(gp, "set nokey\n");
     fprintf(gp, "set size square\n");
     fprintf(gp, "set term gif animate optimize delay 0.1 size 500,500\n");
     fprintf(gp, "set output 'movie.gif'\n");
-    fprintf(gp, "set xr [%f:%f]\n", -sum(l, 0, N), sum(l, 0, N));
-    fprintf(gp, "set yr [%f:%f]\n", -sum(l, 0, N), sum(l, 0, N));
+    fprintf(gp, "set xr [%f:%f]\n", -l.sum(), l.sum());
+    fprintf(gp, "set yr [%f:%f]\n", -l.sum(), l.sum());
 
-    for(int i = 0; t < tlim; i++){
-        if(i%10 == 0){
-            plot(gp, x, l);
-            // std::cout << x.theta << "\n" << std::endl;
+    for(int i = 0; t < config.tlim; i++){
+        if(i%config.frame == 0){
+            plot<Size>(gp, x, l);
+            // std::cout << x.head(l.size()) << "\n" << std::endl;
         }
 
-        k1 = updateCondition(m, l, x);
-        k2 = updateCondition(m, l, x + dt/2*k1);
-        k3 = updateCondition(m, l, x + dt/2*k2);
-        k4 = updateCondition(m, l, x + dt*k3);
-        x = x + dt/6*(k1 + 2*k2 + 2*k3 + k4);
-        t += dt;
+        rk4.step(f, x, t, config.dt);
+        t += config.dt;
     };
-}
\ No newline at end of file
+    pclose(gp);
+}
+
+// おもりの数がmax_fixed以下なら固定長で動かす
+template<int Size>
+void dispatch(const Config &config, const bool lu){
+    if constexpr(Size > max_fixed) simulate<Eigen::Dynamic>(config, lu);
+    else if(static_cast<int>(config.mass.size()) == Size) simulate<Size>(config, lu);
+    else dispatch<Size + 1>(config, lu);
+}
+
+int main(int argc, char *argv[]){
+    bool lu = false;
+    Config config = defaultConfig(5);
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if(arg == "--bench"){
+            bench();
+            return 0;
+        }
+        else if(arg == "--lu") lu = true;
+        else if(arg == "--config" && i + 1 < argc){
+            if(!readConfig(argv[++i], config)){
+                std::cerr << "wrong config " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+    }
+    dispatch<1>(config, lu);
+}
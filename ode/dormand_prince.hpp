@@ -0,0 +1,162 @@
+/**
+ * @file dormand_prince.hpp
+ * @brief 刻み幅を自動で調節するDormand-Prince法(RK45)
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>    // min,max
+#include <cmath>
+#include <limits>
+#include <utility>      // swap
+
+#include "state.hpp"
+
+namespace ode {
+
+/**
+ * @brief Dormand-Prince 5(4)次の埋め込み型Runge-Kutta法の積分器
+ * @details 5次の解で進め，4次の解との差を局所誤差とする．誤差のRMSノルムが1以下ならステップを受け入れ，
+ *          次の刻み幅を0.9*err^(-1/5)倍(0.2倍から5倍の範囲)にする．
+ *          最後の段の値は次のステップの最初の段の値になる(FSAL)ので，受け入れたステップの右辺の評価は6回．
+ *          右辺はf(x, dxdt, t)の形で，段の値と途中の状態はメンバに持つ．可変長の状態量は同じ大きさの見本を渡して作る．
+ *          誤差の計算にerror_norm(err, x0, x1, atol, rtol)を使うので，Eigenの行列か算術型以外の状態量ではオーバーロードを用意する．
+ *          誤差がNaNや無限大になったステップは捨てて刻み幅を0.2倍にする．integrateは刻み幅がh_minより小さくなるか
+ *          tに足しても変わらなくなったとき，またはステップ数がmax_stepsを超えたときに止めてfalseを返す．
+ */
+template<class State, class Scalar = scalar_of_t<State> >
+class DormandPrince45{
+private:
+    State k1, k2, k3, k4, k5, k6, k7, y, err;
+    bool fsal;          // k1が今の状態量の右辺の値か
+    Scalar h;           // 次に試す刻み幅
+    Scalar atol, rtol;
+    Scalar h_min;       // 刻み幅の下限
+    long long max_steps;    // integrate 1回で試すステップ数の上限
+    long long accepted_steps, rejected_steps;
+public:
+    explicit DormandPrince45(const State &like = zero_state<State>(), const Scalar &atol = Scalar(1e-8), const Scalar &rtol = Scalar(1e-8), const Scalar &h0 = Scalar(1e-3));
+    template<class System>
+    bool try_step(System &&f, State &x, Scalar &t);
+    template<class System>
+    bool integrate(System &&f, State &x, Scalar &t, const Scalar &t_end);
+    void reset(){ fsal = false; }
+    const Scalar &step_size() const { return h; }
+    void set_step_size(const Scalar &h0){ h = h0; }
+    void set_min_step_size(const Scalar &h0){ h_min = h0; }
+    void set_max_steps(const long long n){ max_steps = n; }
+    long long accepted() const { return accepted_steps; }
+    long long rejected() const { return rejected_steps; }
+};
+
+/**
+ * @param[in] like 大きさの見本の状態量(可変長のとき), atol 絶対許容誤差, rtol 相対許容誤差, h0 最初に試す刻み幅
+ */
+template<class State, class Scalar>
+DormandPrince45<State, Scalar>::DormandPrince45(const State &like, const Scalar &atol, const Scalar &rtol, const Scalar &h0)
+    : k1(like), k2(like), k3(like), k4(like), k5(like), k6(like), k7(like), y(like), err(like)
+    , fsal(false)
+    , h(h0)
+    , atol(atol)
+    , rtol(rtol)
+    , h_min(0)
+    , max_steps(1000000)
+    , accepted_steps(0)
+    , rejected_steps(0)
+{
+}
+
+/**
+ * @brief 今の刻み幅で1ステップ試す
+ * @param[in] f 右辺
+ * @param[in,out] x 状態量, t 時刻
+ * @param[out] bool ステップを受け入れたか
+ * @details 受け入れたらxとtを進める．どちらの場合も次に試す刻み幅を更新する．
+ *          呼び出し側でxを書き換えたときはreset()を呼ぶこと．
+ */
+template<class State, class Scalar>
+template<class System>
+bool DormandPrince45<State, Scalar>::try_step(System &&f, State &x, Scalar &t){
+    using std::pow;
+    using std::min;
+    using std::max;
+    // Butcher表
+    static const Scalar c2 = Scalar(1)/5, c3 = Scalar(3)/10, c4 = Scalar(4)/5, c5 = Scalar(8)/9;
+    static const Scalar a21 = Scalar(1)/5;
+    static const Scalar a31 = Scalar(3)/40, a32 = Scalar(9)/40;
+    static const Scalar a41 = Scalar(44)/45, a42 = Scalar(-56)/15, a43 = Scalar(32)/9;
+    static const Scalar a51 = Scalar(19372)/6561, a52 = Scalar(-25360)/2187, a53 = Scalar(64448)/6561, a54 = Scalar(-212)/729;
+    static const Scalar a61 = Scalar(9017)/3168, a62 = Scalar(-355)/33, a63 = Scalar(46732)/5247, a64 = Scalar(49)/176, a65 = Scalar(-5103)/18656;
+    static const Scalar a71 = Scalar(35)/384, a73 = Scalar(500)/1113, a74 = Scalar(125)/192, a75 = Scalar(-2187)/6784, a76 = Scalar(11)/84;
+    // 5次と4次の重みの差
+    static const Scalar e1 = Scalar(71)/57600, e3 = Scalar(-71)/16695, e4 = Scalar(71)/1920, e5 = Scalar(-17253)/339200, e6 = Scalar(22)/525, e7 = Scalar(-1)/40;
+
+    if(!fsal){
+        f(x, k1, t);
+        fsal = true;
+    }
+    y = x + h*(a21*k1);
+    f(y, k2, Scalar(t + c2*h));
+    y = x + h*(a31*k1 + a32*k2);
+    f(y, k3, Scalar(t + c3*h));
+    y = x + h*(a41*k1 + a42*k2 + a43*k3);
+    f(y, k4, Scalar(t + c4*h));
+    y = x + h*(a51*k1 + a52*k2 + a53*k3 + a54*k4);
+    f(y, k5, Scalar(t + c5*h));
+    y = x + h*(a61*k1 + a62*k2 + a63*k3 + a64*k4 + a65*k5);
+    f(y, k6, Scalar(t + h));
+    y = x + h*(a71*k1 + a73*k3 + a74*k4 + a75*k5 + a76*k6);
+    f(y, k7, Scalar(t + h));
+    err = h*(e1*k1 + e3*k3 + e4*k4 + e5*k5 + e6*k6 + e7*k7);
+
+    const Scalar e = error_norm(err, x, y, atol, rtol);
+    if(!(e <= std::numeric_limits<Scalar>::max())){
+        // NaNか無限大
+        h *= Scalar(0.2);
+        rejected_steps++;
+        return false;
+    }
+    const Scalar factor = e > Scalar(0) ? Scalar(Scalar(0.9)*pow(e, Scalar(-0.2))) : Scalar(5);
+    if(e <= Scalar(1)){
+        std::swap(x, y);
+        std::swap(k1, k7);
+        t += h;
+        h *= min(Scalar(5), factor);
+        accepted_steps++;
+        return true;
+    }
+    h *= max(Scalar(0.2), factor);
+    rejected_steps++;
+    return false;
+}
+
+/**
+ * @brief 時刻t_endまで進める
+ * @param[in] f 右辺, t_end 終わりの時刻
+ * @param[in,out] x 状態量, t 時刻
+ * @param[out] bool t_endに着いたか．刻み幅が小さくなりすぎたかステップ数がmax_stepsを超えたらfalseで，xとtはそこまで進めた値．
+ * @details 最後のステップはt_endにちょうど着くように縮め，そのときに決まった次の刻み幅は使わずに元の刻み幅を残す．
+ */
+template<class State, class Scalar>
+template<class System>
+bool DormandPrince45<State, Scalar>::integrate(System &&f, State &x, Scalar &t, const Scalar &t_end){
+    fsal = false;
+    for(long long n = 0; t < t_end; n++){
+        if(n >= max_steps || h < h_min || t + h == t) return false;
+        const Scalar remain = t_end - t;
+        if(h >= remain){
+            const Scalar h_keep = h;
+            h = remain;
+            if(try_step(f, x, t)){
+                t = t_end;
+                h = h_keep;
+                break;
+            }
+        }
+        else try_step(f, x, t);
+    }
+    return true;
+}
+
+} // namespace ode
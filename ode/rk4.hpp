@@ -0,0 +1,50 @@
+/**
+ * @file rk4.hpp
+ * @brief 古典的4次Runge-Kutta法
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include "state.hpp"
+
+namespace ode {
+
+/**
+ * @brief 4次Runge-Kutta法の積分器
+ * @details 右辺はf(x, dxdt, t)の形で，dxdtに書き込む．
+ *          段の値k1..k4と途中の状態はメンバに持つので，固定長の状態量ならステップごとのメモリ確保はない．
+ *          可変長の状態量(Eigen::VectorXdなど)は，同じ大きさの状態量を渡して作れば各バッファを最初に確保する．
+ *          Stateは状態量同士の+とScalarとの*が使えればよい．
+ */
+template<class State, class Scalar = scalar_of_t<State> >
+class RK4{
+private:
+    State k1, k2, k3, k4, tmp;
+public:
+    RK4() = default;
+    explicit RK4(const State &like) : k1(like), k2(like), k3(like), k4(like), tmp(like) {}
+    template<class System>
+    void step(System &&f, State &x, const Scalar &t, const Scalar &h);
+};
+
+/**
+ * @brief 1ステップ進める
+ * @param[in] f 右辺, t 時刻, h 刻み幅
+ * @param[in,out] x 状態量
+ */
+template<class State, class Scalar>
+template<class System>
+void RK4<State, Scalar>::step(System &&f, State &x, const Scalar &t, const Scalar &h){
+    const Scalar half = h/Scalar(2);
+    f(x, k1, t);
+    tmp = x + half*k1;
+    f(tmp, k2, Scalar(t + half));
+    tmp = x + half*k2;
+    f(tmp, k3, Scalar(t + half));
+    tmp = x + h*k3;
+    f(tmp, k4, Scalar(t + h));
+    x = x + (h/Scalar(6))*(k1 + Scalar(2)*k2 + Scalar(2)*k3 + k4);
+}
+
+} // namespace ode
@@ -0,0 +1,71 @@
+/**
+ * @file state.hpp
+ * @brief 常微分方程式の状態量についての共通の道具
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>    // max
+#include <cmath>
+#include <type_traits>
+
+#include <Eigen/Core>
+
+namespace ode {
+
+/**
+ * @brief 状態量の成分の型
+ * @details Eigenの行列ならScalar，算術型ならその型．それ以外の型は特殊化するか，積分器のテンプレート引数で指定する．
+ */
+template<class State, class = void>
+struct scalar_of{
+    using type = State;
+};
+
+template<class State>
+struct scalar_of<State, std::void_t<typename State::Scalar> >{
+    using type = typename State::Scalar;
+};
+
+template<class State>
+using scalar_of_t = typename scalar_of<State>::type;
+
+/**
+ * @brief 成分がすべて0の状態量
+ * @details 積分器の作業領域の見本のデフォルト値に使う．可変長のEigenの行列は大きさ0になるので，見本を渡すこと．
+ */
+template<class State>
+State zero_state(){
+    if constexpr(std::is_base_of<Eigen::EigenBase<State>, State>::value){
+        if constexpr(State::SizeAtCompileTime != Eigen::Dynamic) return State::Zero();
+        else return State();
+    }
+    else return State{};
+}
+
+/**
+ * @brief 誤差の大きさ(RMSノルム)
+ * @param[in] err 局所誤差, x0 ステップ前の状態, x1 ステップ後の状態, atol 絶対許容誤差, rtol 相対許容誤差
+ * @details 成分ごとにatol + rtol*max(|x0|, |x1|)で割った値の二乗平均の平方根．1以下ならステップを受け入れる．
+ */
+template<class Derived, class Scalar>
+Scalar error_norm(const Eigen::MatrixBase<Derived> &err, const Eigen::MatrixBase<Derived> &x0, const Eigen::MatrixBase<Derived> &x1, const Scalar &atol, const Scalar &rtol){
+    using std::abs;
+    using std::sqrt;
+    using std::max;
+    Scalar total = 0;
+    for(Eigen::Index i = 0; i < err.size(); i++){
+        const Scalar scale = atol + rtol*max(Scalar(abs(x0(i))), Scalar(abs(x1(i))));
+        const Scalar e = err(i)/scale;
+        total += e*e;
+    }
+    return Scalar(sqrt(total/Scalar(err.size())));
+}
+
+template<class Scalar, class = std::enable_if_t<std::is_arithmetic<Scalar>::value> >
+Scalar error_norm(const Scalar err, const Scalar x0, const Scalar x1, const Scalar atol, const Scalar rtol){
+    return std::abs(err)/(atol + rtol*std::max(std::abs(x0), std::abs(x1)));
+}
+
+} // namespace ode
@@ -0,0 +1,275 @@
+/**
+ * @file symplectic.hpp
+ * @brief ハミルトン系のシンプレクティック積分法
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include "state.hpp"
+
+namespace ode {
+
+/**
+ * @brief ハミルトン系の右辺の形
+ * @details 一般化座標qと正準運動量pについて，velocity(q, p, dqdt)がdqdt = ∂H/∂pを，force(q, p, dpdt)がdpdt = -∂H/∂qを書き込む．
+ *          Hは時間によらないとする．振り子のように運動エネルギーがqにもよる(分離できない)Hでも使えるように，
+ *          陰的な式はNewton法(NewtonSolver)で解く．CoordはEigenの列ベクトル．
+ *          積分器はすべて対称かつシンプレクティックなので，エネルギーの誤差はずっと有界のまま増えない．
+ *          stepは陰的な式が解けなかったときfalseを返し，q, pを変えない．
+ */
+
+/**
+ * @brief 陰的な式 z = φ(z) をNewton法で解く
+ * @details φ(z, out)がoutにφ(z)を書き込む．ヤコビアンI - ∂φ/∂zは前進差分で作って次のsolveでも使い回し，
+ *          更新量が前の半分より小さくならなかったときだけ作り直す(簡略Newton法)．刻み幅が同じなら
+ *          ヤコビアンはほとんど変わらないので，1回のsolveでφを2, 3回評価するだけで済む．
+ *          更新量がerror_norm(dz, 前の値, 新しい値, tol, tol) <= 1になれば収束とする．
+ */
+template<class Vector, class Scalar = scalar_of_t<Vector> >
+class NewtonSolver{
+private:
+    using Jacobian = Eigen::Matrix<Scalar, Vector::RowsAtCompileTime, Vector::RowsAtCompileTime>;
+    Vector r, rp, zp, z_old, dz;
+    Jacobian J;
+    Eigen::PartialPivLU<Jacobian> lu;
+    bool has_jacobian = false;
+    Scalar tol;
+    int max_iter;
+
+    template<class Map>
+    void residual(Map &&phi, const Vector &z, Vector &out){
+        phi(z, out);
+        out = z - out;
+    }
+    template<class Map>
+    void update_jacobian(Map &&phi, const Vector &z);
+public:
+    NewtonSolver(const Vector &like, const Scalar &tol, const int max_iter)
+        : r(like), rp(like), zp(like), z_old(like), dz(like), J(like.size(), like.size()), lu(like.size()), tol(tol), max_iter(max_iter) {}
+    /**
+     * @brief ヤコビアンを捨てる(φが大きく変わったとき)
+     */
+    void reset(){ has_jacobian = false; }
+    template<class Map>
+    bool solve(Map &&phi, Vector &z);
+};
+
+template<class Vector, class Scalar>
+template<class Map>
+void NewtonSolver<Vector, Scalar>::update_jacobian(Map &&phi, const Vector &z){
+    using std::abs;
+    using std::max;
+    using std::sqrt;
+    const Scalar delta = sqrt(std::numeric_limits<Scalar>::epsilon());
+    for(Eigen::Index j = 0; j < z.size(); j++){
+        zp = z;
+        const Scalar e = delta*max(Scalar(abs(z(j))), Scalar(1));
+        zp(j) += e;
+        residual(phi, zp, rp);
+        J.col(j) = (rp - r)/e;
+    }
+    lu.compute(J);
+    has_jacobian = true;
+}
+
+/**
+ * @brief 解く
+ * @param[in] phi 不動点の写像
+ * @param[in,out] z 初期値，収束すれば解
+ * @param[out] bool max_iter回以内に収束したか(値が有限でなくなったときも失敗)
+ */
+template<class Vector, class Scalar>
+template<class Map>
+bool NewtonSolver<Vector, Scalar>::solve(Map &&phi, Vector &z){
+    residual(phi, z, r);
+    Scalar last = std::numeric_limits<Scalar>::infinity();
+    for(int it = 0; it < max_iter; it++){
+        if(!has_jacobian) update_jacobian(phi, z);
+        dz = lu.solve(r);
+        z_old = z;
+        z -= dz;
+        if(!z.allFinite()){
+            has_jacobian = false;
+            return false;
+        }
+        const Scalar norm = error_norm(dz, z_old, z, tol, tol);
+        if(norm <= Scalar(1)) return true;
+        if(!(norm < last/Scalar(2))) has_jacobian = false;
+        last = norm;
+        residual(phi, z, r);
+    }
+    has_jacobian = false;
+    return false;
+}
+
+/**
+ * @brief 陰的中点法(2次)
+ * @details y1 = y0 + h f((y0 + y1)/2)．中点(qm, pm)を並べたベクトルについてNewton法で解く．
+ */
+template<class Coord, class Scalar = scalar_of_t<Coord> >
+class ImplicitMidpoint{
+private:
+    static constexpr int Rows = Coord::RowsAtCompileTime;
+    using Stacked = Eigen::Matrix<Scalar, Rows == Eigen::Dynamic ? Eigen::Dynamic : 2*Rows, 1>;
+    Coord qm, pm, vq, fp;
+    Stacked z;
+    NewtonSolver<Stacked, Scalar> newton;
+    Scalar last_h = 0;
+public:
+    explicit ImplicitMidpoint(const Coord &like = zero_state<Coord>(), const Scalar &tol = Scalar(1e-14), const int max_iter = 50)
+        : qm(like), pm(like), vq(like), fp(like), z(Stacked::Zero(2*like.size())), newton(Stacked::Zero(2*like.size()), tol, max_iter) {}
+    template<class Velocity, class Force>
+    bool step(Velocity &&velocity, Force &&force, Coord &q, Coord &p, const Scalar &h);
+};
+
+/**
+ * @brief 1ステップ進める
+ * @param[in] velocity ∂H/∂p, force -∂H/∂q, h 刻み幅
+ * @param[in,out] q 一般化座標, p 正準運動量
+ * @param[out] bool 中点が求まったか
+ */
+template<class Coord, class Scalar>
+template<class Velocity, class Force>
+bool ImplicitMidpoint<Coord, Scalar>::step(Velocity &&velocity, Force &&force, Coord &q, Coord &p, const Scalar &h){
+    const Eigen::Index n = q.size();
+    const Scalar half = h/Scalar(2);
+    if(h != last_h) newton.reset();
+    last_h = h;
+    auto phi = [&](const Stacked &x, Stacked &out){
+        qm = x.head(n);
+        pm = x.tail(n);
+        velocity(qm, pm, vq);
+        force(qm, pm, fp);
+        out.head(n) = q + half*vq;
+        out.tail(n) = p + half*fp;
+    };
+    // 陽的Euler法の半ステップを初期値にする
+    velocity(q, p, vq);
+    force(q, p, fp);
+    z.head(n) = q + half*vq;
+    z.tail(n) = p + half*fp;
+    if(!newton.solve(phi, z)) return false;
+    q = Scalar(2)*z.head(n) - q;
+    p = Scalar(2)*z.tail(n) - p;
+    return true;
+}
+
+/**
+ * @brief Störmer-Verlet法(一般化leapfrog, 2次)
+ * @details p(1/2) = p0 + h/2 F(q0, p(1/2))，q1 = q0 + h/2 (V(q0, p(1/2)) + V(q1, p(1/2)))，p1 = p(1/2) + h/2 F(q1, p(1/2))．
+ *          最初の2つは陰的なのでNewton法で解く．
+ */
+template<class Coord, class Scalar = scalar_of_t<Coord> >
+class StormerVerlet{
+private:
+    Coord p_half, q_next, v0, v1, f;
+    NewtonSolver<Coord, Scalar> newton_p, newton_q;
+    Scalar last_h = 0;
+public:
+    explicit StormerVerlet(const Coord &like = zero_state<Coord>(), const Scalar &tol = Scalar(1e-14), const int max_iter = 50)
+        : p_half(like), q_next(like), v0(like), v1(like), f(like), newton_p(like, tol, max_iter), newton_q(like, tol, max_iter) {}
+    template<class Velocity, class Force>
+    bool step(Velocity &&velocity, Force &&force, Coord &q, Coord &p, const Scalar &h);
+};
+
+/**
+ * @brief 1ステップ進める
+ * @param[in] velocity ∂H/∂p, force -∂H/∂q, h 刻み幅
+ * @param[in,out] q 一般化座標, p 正準運動量
+ * @param[out] bool 陰的な式が解けたか
+ */
+template<class Coord, class Scalar>
+template<class Velocity, class Force>
+bool StormerVerlet<Coord, Scalar>::step(Velocity &&velocity, Force &&force, Coord &q, Coord &p, const Scalar &h){
+    const Scalar half = h/Scalar(2);
+    if(h != last_h){
+        newton_p.reset();
+        newton_q.reset();
+    }
+    last_h = h;
+    // p(1/2)
+    force(q, p, f);
+    p_half = p + half*f;
+    if(!newton_p.solve([&](const Coord &x, Coord &out){ force(q, x, f); out = p + half*f; }, p_half)) return false;
+    // q1
+    velocity(q, p_half, v0);
+    q_next = q + h*v0;
+    if(!newton_q.solve([&](const Coord &x, Coord &out){ velocity(x, p_half, v1); out = q + half*(v0 + v1); }, q_next)) return false;
+    // p1
+    force(q_next, p_half, f);
+    q = q_next;
+    p = p_half + half*f;
+    return true;
+}
+
+/**
+ * @brief Yoshidaの合成法
+ * @details 対称な2次のStörmer-Verlet法を刻み幅w_i hで続けて使う．次数kの方法から，γ = 1/(2 - 2^(1/(k+1)))として
+ *          γh, (1 - 2γ)h, γhの3回で次数k+2の方法を作る(triple jump)．Orderが4なら3段，6なら9段，8なら27段．
+ *          段ごとに刻み幅が違うので，Newton法のヤコビアンを使い回せるようにStörmer-Verlet法を段の数だけ持つ．
+ */
+template<class Coord, int Order, class Scalar = scalar_of_t<Coord> >
+class Yoshida{
+    static_assert(Order >= 2 && Order % 2 == 0, "Order must be even");
+private:
+    static constexpr int stages(const int order){ return order == 2 ? 1 : 3*stages(order - 2); }
+    std::vector<StormerVerlet<Coord, Scalar> > base;
+    std::array<Scalar, stages(Order)> w;
+    Coord q0, p0;
+public:
+    explicit Yoshida(const Coord &like = zero_state<Coord>(), const Scalar &tol = Scalar(1e-14), const int max_iter = 50);
+    template<class Velocity, class Force>
+    bool step(Velocity &&velocity, Force &&force, Coord &q, Coord &p, const Scalar &h);
+};
+
+template<class Coord, int Order, class Scalar>
+Yoshida<Coord, Order, Scalar>::Yoshida(const Coord &like, const Scalar &tol, const int max_iter)
+    : q0(like), p0(like)
+{
+    base.reserve(stages(Order));
+    for(int i = 0; i < stages(Order); i++) base.emplace_back(like, tol, max_iter);
+    using std::pow;
+    w[0] = Scalar(1);
+    int n = 1;
+    for(int k = 2; k < Order; k += 2){
+        const Scalar gamma = Scalar(1)/(Scalar(2) - Scalar(pow(Scalar(2), Scalar(1)/Scalar(k + 1))));
+        for(int i = 0; i < n; i++){
+            w[n + i] = (Scalar(1) - Scalar(2)*gamma)*w[i];
+            w[2*n + i] = gamma*w[i];
+            w[i] = gamma*w[i];
+        }
+        n *= 3;
+    }
+}
+
+/**
+ * @brief 1ステップ進める
+ * @param[in] velocity ∂H/∂p, force -∂H/∂q, h 刻み幅
+ * @param[in,out] q 一般化座標, p 正準運動量
+ * @param[out] bool 陰的な式が解けたか(解けなければq, pを変えない)
+ */
+template<class Coord, int Order, class Scalar>
+template<class Velocity, class Force>
+bool Yoshida<Coord, Order, Scalar>::step(Velocity &&velocity, Force &&force, Coord &q, Coord &p, const Scalar &h){
+    q0 = q;
+    p0 = p;
+    for(std::size_t i = 0; i < w.size(); i++){
+        if(!base[i].step(velocity, force, q, p, Scalar(w[i]*h))){
+            q = q0;
+            p = p0;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace ode
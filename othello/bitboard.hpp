@@ -0,0 +1,135 @@
+/**
+ * @file bitboard.hpp
+ * @brief オセロのビットボード
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief 64マスを1ビットずつで表した盤面
+ * @details マス(x, y)(x: 行1-8, y: 列A-H=1-8)はビット(x-1)*8 + (y-1)．A1が最下位ビット．
+ */
+using Bitboard = std::uint64_t;
+
+constexpr Bitboard not_a_file = 0xfefefefefefefefeull; // A列以外
+constexpr Bitboard not_h_file = 0x7f7f7f7f7f7f7f7full; // H列以外
+
+/**
+ * @brief 座標をビット番号に変換する
+ */
+constexpr int square(const int x, const int y){
+    return (x - 1)*8 + (y - 1);
+}
+
+/**
+ * @brief ある方向に1マスずらす
+ * @details Dは+1が右(列+1)，+8が下(行+1)．左右にずれる方向は端から反対側へ回り込んだビットを消す．
+ */
+template<int D>
+constexpr Bitboard shift(const Bitboard b){
+    constexpr int col = ((D % 8) + 8 + 4) % 8 - 4; // 列方向の移動量(-1, 0, +1)
+    constexpr Bitboard mask = col > 0 ? not_a_file : (col < 0 ? not_h_file : ~Bitboard(0));
+    return (D > 0 ? b << D : b >> -D) & mask;
+}
+
+/**
+ * @brief ある方向について打てるマスを求める(Kogge-Stone)
+ * @details 自分の石pから相手の石oが連続する範囲を，1, 2, 4マスずつずらして並列に伸ばす．
+ *          伸ばした範囲のうち相手の石の部分の1マス先が打てるマスの候補．
+ */
+template<int D>
+inline Bitboard moves_dir(const Bitboard p, const Bitboard o){
+    Bitboard g = p, q = o;
+    g |= q & shift<D>(g);
+    q &= shift<D>(q);
+    g |= q & shift<D>(shift<D>(g));
+    q &= shift<D>(shift<D>(q));
+    g |= q & shift<D>(shift<D>(shift<D>(shift<D>(g))));
+    return shift<D>(g ^ p);
+}
+
+/**
+ * @brief 打てるマスの集合
+ * @param[in] p 手番側の石, o 相手の石
+ */
+inline Bitboard get_moves(const Bitboard p, const Bitboard o){
+    const Bitboard m = moves_dir<1>(p, o) | moves_dir<-1>(p, o) | moves_dir<8>(p, o) | moves_dir<-8>(p, o)
+                     | moves_dir<9>(p, o) | moves_dir<-9>(p, o) | moves_dir<7>(p, o) | moves_dir<-7>(p, o);
+    return m & ~(p | o);
+}
+
+/**
+ * @brief ある方向についてひっくり返る石
+ * @details 打ったマスmから相手の石が連続する範囲を伸ばし，その1マス先が自分の石なら範囲を返す．
+ */
+template<int D>
+inline Bitboard flips_dir(const Bitboard p, const Bitboard o, const Bitboard m){
+    Bitboard g = m, q = o;
+    g |= q & shift<D>(g);
+    q &= shift<D>(q);
+    g |= q & shift<D>(shift<D>(g));
+    q &= shift<D>(shift<D>(q));
+    g |= q & shift<D>(shift<D>(shift<D>(shift<D>(g))));
+    return (shift<D>(g) & p) ? (g ^ m) : 0;
+}
+
+/**
+ * @brief マスsqに打ったときにひっくり返る石
+ * @param[in] p 手番側の石, o 相手の石, sq 打つマス
+ */
+inline Bitboard get_flips(const Bitboard p, const Bitboard o, const int sq){
+    const Bitboard m = Bitboard(1) << sq;
+    return flips_dir<1>(p, o, m) | flips_dir<-1>(p, o, m) | flips_dir<8>(p, o, m) | flips_dir<-8>(p, o, m)
+         | flips_dir<9>(p, o, m) | flips_dir<-9>(p, o, m) | flips_dir<7>(p, o, m) | flips_dir<-7>(p, o, m);
+}
+
+/**
+ * @brief 1のビットの個数
+ */
+inline int popcount(const Bitboard b){
+    return __builtin_popcountll(b);
+}
+
+/**
+ * @brief 最下位の1のビット番号
+ */
+inline int first_square(const Bitboard b){
+    return __builtin_ctzll(b);
+}
+
+/**
+ * @brief 終局したときの石差
+ * @details 空きマスは勝った側のものとして数える．
+ */
+inline int final_discs(const Bitboard p, const Bitboard o){
+    int diff = popcount(p) - popcount(o);
+    const int empties = 64 - popcount(p | o);
+    if(diff > 0) diff += empties;
+    else if(diff < 0) diff -= empties;
+    return diff;
+}
+
+/**
+ * @brief 指定した深さまでの局面数を数える
+ * @param[in] p 手番側の石, o 相手の石, depth 深さ
+ * @details パスも1手と数え，両者とも打てない局面(終局)はそこで葉とする．
+ */
+inline long long perft(const Bitboard p, const Bitboard o, const int depth){
+    if(depth == 0) return 1;
+    Bitboard moves = get_moves(p, o);
+    if(moves == 0){
+        if(get_moves(o, p) == 0) return 1;
+        return perft(o, p, depth - 1);
+    }
+    if(depth == 1) return popcount(moves);
+    long long nodes = 0;
+    for(; moves; moves &= moves - 1){
+        const int sq = first_square(moves);
+        const Bitboard f = get_flips(p, o, sq);
+        nodes += perft(o ^ f, p | f | (Bitboard(1) << sq), depth - 1);
+    }
+    return nodes;
+}
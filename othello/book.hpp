@@ -0,0 +1,254 @@
+/**
+ * @file book.hpp
+ * @brief mmapで読む定石
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>      // memcmp
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap,munmap
+#include <sys/stat.h>   // fstat
+#include <unistd.h>     // close
+
+#include "bitboard.hpp"
+#include "position.hpp"
+#include "record.hpp"
+#include "search.hpp"
+#include "transposition.hpp"
+
+/**
+ * @brief 盤を上下に反転する
+ */
+inline Bitboard flip_vertical(const Bitboard b){
+    return __builtin_bswap64(b);
+}
+
+/**
+ * @brief 盤を左右に反転する
+ */
+inline Bitboard flip_horizontal(Bitboard b){
+    b = ((b >> 1) & 0x5555555555555555ull) | ((b & 0x5555555555555555ull) << 1);
+    b = ((b >> 2) & 0x3333333333333333ull) | ((b & 0x3333333333333333ull) << 2);
+    b = ((b >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((b & 0x0F0F0F0F0F0F0F0Full) << 4);
+    return b;
+}
+
+/**
+ * @brief A1-H8の対角線で反転する(行と列を入れ替える)
+ */
+inline Bitboard flip_diagonal(Bitboard b){
+    Bitboard t;
+    t = 0x0F0F0F0F00000000ull & (b ^ (b << 28));
+    b ^= t ^ (t >> 28);
+    t = 0x3333000033330000ull & (b ^ (b << 14));
+    b ^= t ^ (t >> 14);
+    t = 0x5500550055005500ull & (b ^ (b << 7));
+    b ^= t ^ (t >> 7);
+    return b;
+}
+
+/**
+ * @brief 8通りの対称のs番目で写す
+ * @details sの1のビットで上下，2のビットで左右，4のビットで対角線の反転をこの順にする．
+ */
+inline Bitboard transform(Bitboard b, const int s){
+    if(s & 1) b = flip_vertical(b);
+    if(s & 2) b = flip_horizontal(b);
+    if(s & 4) b = flip_diagonal(b);
+    return b;
+}
+
+/**
+ * @brief transformの逆
+ */
+inline Bitboard inverse_transform(Bitboard b, const int s){
+    if(s & 4) b = flip_diagonal(b);
+    if(s & 2) b = flip_horizontal(b);
+    if(s & 1) b = flip_vertical(b);
+    return b;
+}
+
+/**
+ * @brief 対称な局面で同じになるハッシュ値
+ * @param[out] symmetry 選んだ対称の番号
+ * @details 8通りに写したうちハッシュ値が最小のものを代表にする．
+ */
+inline std::uint64_t canonical_hash(const Bitboard p, const Bitboard o, int &symmetry){
+    std::uint64_t best = ~std::uint64_t(0);
+    symmetry = 0;
+    for(int s = 0; s < 8; s++){
+        const std::uint64_t h = hash_position(transform(p, s), transform(o, s));
+        if(h < best){
+            best = h;
+            symmetry = s;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 定石の1局面，16バイト
+ * @details moveは代表の向きでのマス．scoreはSearcherと同じ単位．
+ */
+struct BookEntry{
+    std::uint64_t key;
+    std::int32_t score;
+    std::uint8_t move;
+    std::uint8_t depth;
+    std::uint16_t pad;
+};
+
+/**
+ * @brief 定石ファイル
+ * @details 先頭は"OTHBOOK1"とuint64の局面数(計16バイト)．そのあとにBookEntryがkeyの昇順に並ぶ．
+ *          mmapで読み込み専用に写して二分探索するだけなので読み込みは一瞬で，同じ計算機のプロセスどうしでページを共有する．
+ */
+class OpeningBook{
+private:
+    void *map;
+    std::size_t length;
+    const BookEntry *entries;
+    std::size_t n;
+public:
+    OpeningBook() : map(nullptr), length(0), entries(nullptr), n(0) {}
+    ~OpeningBook();
+    OpeningBook(const OpeningBook&) = delete;
+    OpeningBook &operator=(const OpeningBook&) = delete;
+    bool load(const std::string &filename);
+    bool good() const { return entries != nullptr; }
+    std::size_t size() const { return n; }
+    bool probe(const Bitboard p, const Bitboard o, int &move, int &score, int &depth) const;
+};
+
+inline OpeningBook::~OpeningBook(){
+    if(map) munmap(map, length);
+}
+
+inline bool OpeningBook::load(const std::string &filename){
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < 16){
+        close(fd);
+        return false;
+    }
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) return false;
+    const char *p = static_cast<const char*>(m);
+    std::uint64_t count;
+    std::memcpy(&count, p + 8, 8);
+    if(std::memcmp(p, "OTHBOOK1", 8) != 0 || static_cast<std::size_t>(st.st_size) != 16 + count*sizeof(BookEntry)){
+        munmap(m, st.st_size);
+        return false;
+    }
+    if(map) munmap(map, length);
+    map = m;
+    length = st.st_size;
+    entries = reinterpret_cast<const BookEntry*>(p + 16);
+    n = count;
+    return true;
+}
+
+/**
+ * @brief 局面を引く
+ * @param[out] move この局面の向きでの最善手, score 評価値, depth 読んだ深さ
+ * @param[out] bool 載っていて，その手が打てる手だったか
+ */
+inline bool OpeningBook::probe(const Bitboard p, const Bitboard o, int &move, int &score, int &depth) const {
+    if(!entries) return false;
+    int s;
+    const std::uint64_t key = canonical_hash(p, o, s);
+    const BookEntry *e = std::lower_bound(entries, entries + n, key, [](const BookEntry &a, const std::uint64_t k){ return a.key < k; });
+    if(e == entries + n || e->key != key) return false;
+    // 壊れた定石や別の定石の手は使わない
+    if(e->move > 63) return false;
+    const int m = first_square(inverse_transform(Bitboard(1) << e->move, s));
+    if(((get_moves(p, o) >> m) & 1) == 0) return false;
+    move = m;
+    score = e->score;
+    depth = e->depth;
+    return true;
+}
+
+/**
+ * @brief 定石の作り方
+ */
+struct BookConfig{
+    std::string records;    // 序盤の局面を集める棋譜
+    std::string output;
+    int plies = 12;         // 初期局面から何手目までの局面を載せるか
+    int depth = 10;         // 1局面を読む深さ
+    int min_count = 1;      // 棋譜に何回以上出た局面を載せるか
+    int threads = 1;
+    std::size_t megabytes = 64;
+};
+
+/**
+ * @brief 棋譜の序盤の局面を集めて1つずつ読み，定石ファイルを作る
+ * @details 対称な局面は代表の向きにまとめる．局面はスレッドで分けて読み，スレッドごとに置換表を持つ．
+ */
+inline bool build_book(const BookConfig &config){
+    struct Item{ Bitboard p, o; int count; };
+    std::unordered_map<std::uint64_t, Item> positions;
+    RecordReader reader(config.records);
+    if(!reader.good()){
+        std::cerr << "cannot read " << config.records << std::endl;
+        return false;
+    }
+    GameRecord g;
+    long long games = 0;
+    while(reader.next(g)){
+        games++;
+        int ply = 0;
+        replay(g, [&](const Position &pos, int){
+            if(ply++ >= config.plies) return;
+            int s;
+            const std::uint64_t key = canonical_hash(pos.player(), pos.opponent(), s);
+            auto it = positions.find(key);
+            if(it == positions.end()) positions.emplace(key, Item{transform(pos.player(), s), transform(pos.opponent(), s), 1});
+            else it->second.count++;
+        });
+    }
+    std::vector< std::pair<std::uint64_t, Item> > items;
+    for(auto&& kv : positions) if(kv.second.count >= config.min_count) items.push_back(kv);
+    std::cout << "games " << games << "  positions " << positions.size() << "  in book " << items.size() << std::endl;
+
+    std::vector<BookEntry> entries(items.size());
+    std::atomic<std::size_t> next(0);
+    const int threads = std::max(1, config.threads);
+    auto work = [&](){
+        TranspositionTable tt(std::max<std::size_t>(1, config.megabytes / threads));
+        for(std::size_t i; (i = next.fetch_add(1)) < items.size(); ){
+            const Item &it = items[i].second;
+            tt.new_search();
+            Searcher searcher(tt);
+            const SearchResult r = searcher.search(it.p, it.o, 1e6, config.depth);
+            entries[i] = {items[i].first, r.score, static_cast<std::uint8_t>(r.move), static_cast<std::uint8_t>(r.depth), 0};
+            if(i % 1000 == 999) std::cout << i + 1 << " / " << items.size() << std::endl;
+        }
+    };
+    std::vector<std::thread> helpers;
+    for(int t = 1; t < threads; t++) helpers.emplace_back(work);
+    work();
+    for(auto&& t : helpers) t.join();
+
+    std::sort(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b){ return a.key < b.key; });
+    std::ofstream file(config.output, std::ios::binary);
+    const std::uint64_t count = entries.size();
+    file.write("OTHBOOK1", 8);
+    file.write(reinterpret_cast<const char*>(&count), 8);
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size()*sizeof(BookEntry));
+    return file.good();
+}
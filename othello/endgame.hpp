@@ -0,0 +1,318 @@
+/**
+ * @file endgame.hpp
+ * @brief 終盤の完全読み
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bitboard.hpp"
+#include "search.hpp"
+#include "transposition.hpp"
+
+/**
+ * @brief 空きマスが奇数個の象限を表すマスク
+ * @details 最後の数マスでは，空きが奇数個の象限に先に打つと最後の1手を自分が打ちやすい(偶数理論)．
+ */
+inline Bitboard odd_quadrants(const Bitboard empty){
+    constexpr Bitboard quadrant[4] = {0x000000000F0F0F0Full, 0x00000000F0F0F0F0ull, 0x0F0F0F0F00000000ull, 0xF0F0F0F000000000ull};
+    Bitboard odd = 0;
+    for(int i = 0; i < 4; i++){
+        if(popcount(empty & quadrant[i]) & 1) odd |= quadrant[i];
+    }
+    return odd;
+}
+
+/**
+ * @brief 4方向の線がすべて埋まっているマス
+ * @details 横・縦・2つの斜めの線がどれも埋まっているマスの石は二度と返らない．
+ */
+inline Bitboard full_lines(const Bitboard filled){
+    Bitboard h = filled & (filled >> 1) & (filled >> 2) & (filled >> 3) & (filled >> 4) & (filled >> 5) & (filled >> 6) & (filled >> 7) & 0x0101010101010101ull;
+    h *= 0xff;
+    Bitboard v = filled & (filled >> 8);
+    v &= v >> 16;
+    v &= v >> 32;
+    v = (v & 0xff)*0x0101010101010101ull;
+    Bitboard d9 = filled, d7 = filled;
+    Bitboard e9 = filled, e7 = filled;
+    for(int i = 0; i < 7; i++){
+        // 盤の外(斜めの線の端)は埋まっているものとして扱う
+        d9 &= shift<9>(d9) | 0x01010101010101ffull;
+        e9 &= shift<-9>(e9) | 0xff80808080808080ull;
+        d7 &= shift<7>(d7) | 0x80808080808080ffull;
+        e7 &= shift<-7>(e7) | 0xff01010101010101ull;
+    }
+    return h & v & d9 & e9 & d7 & e7;
+}
+
+/**
+ * @brief 相手の確定石の下限
+ * @details 隅と，4方向の線がすべて埋まったマス．
+ */
+inline Bitboard stable_discs(const Bitboard p, const Bitboard o){
+    return o & (full_lines(p | o) | 0x8100000000000081ull);
+}
+
+/**
+ * @brief 最終石差を求める完全読み
+ * @details 評価値は手番側から見た石差(-64から64)．探索中はヒープを使わない(置換表は前もって確保したもの)．
+ *          空きが5マス以上では，相手の着手可能数が少ない順(fastest-first)，同じなら空きが奇数個の象限を先に読み，
+ *          最初の手より後の手は窓の幅1で調べてから必要なときだけ読み直す(PVS)．
+ *          空きが4マス以下では着手可能なマスを求めずに空きマスに直接打ってみて，象限の偶奇の順に読む．残り1マスは石数だけで求める．
+ *          空きが8マス以上の局面は置換表を使う．置換表の評価値はSearcherと同じ単位(石差×disc_value)で入れる．
+ */
+class EndgameSolver{
+private:
+    TranspositionTable &tt;
+    long long nodes;
+    long long tt_probes, tt_hits;
+    int solve_last1(const Bitboard p, const Bitboard o, const int sq);
+    int solve_last(const Bitboard p, const Bitboard o, int alpha, const int beta, const int *squares, const int n, const bool passed);
+public:
+    explicit EndgameSolver(TranspositionTable &table) : tt(table), nodes(0), tt_probes(0), tt_hits(0) {}
+    int solve(const Bitboard p, const Bitboard o, int alpha, int beta, const bool passed);
+    int order_moves(const Bitboard p, const Bitboard o, Bitboard moves, const int tt_move, int *list) const;
+    long long node_count() const { return nodes; }
+    long long probe_count() const { return tt_probes; }
+    long long hit_count() const { return tt_hits; }
+};
+
+/**
+ * @brief 残り1マス
+ */
+inline int EndgameSolver::solve_last1(const Bitboard p, const Bitboard o, const int sq){
+    nodes++;
+    const int n_p = popcount(p);
+    Bitboard f = get_flips(p, o, sq);
+    if(f) return 2*(n_p + 1 + popcount(f)) - 64;
+    f = get_flips(o, p, sq);
+    nodes++;
+    if(f) return 2*(n_p - popcount(f)) - 64;
+    const int diff = 2*n_p - 63; // 石の合計が63なので0にはならない
+    return diff > 0 ? diff + 1 : diff - 1;
+}
+
+/**
+ * @brief 残り2から4マス
+ * @param[in] squares 空きマス, n 空きマスの数
+ */
+inline int EndgameSolver::solve_last(const Bitboard p, const Bitboard o, int alpha, const int beta, const int *squares, const int n, const bool passed){
+    if(n == 1) return solve_last1(p, o, squares[0]);
+    nodes++;
+    int best = -65;
+    int rest[4];
+    for(int i = 0; i < n; i++){
+        const int sq = squares[i];
+        const Bitboard f = get_flips(p, o, sq);
+        if(f == 0) continue;
+        for(int j = 0, k = 0; j < n; j++) if(j != i) rest[k++] = squares[j];
+        const int score = -solve_last(o ^ f, p | f | (Bitboard(1) << sq), -beta, -alpha, rest, n - 1, false);
+        if(score > best){
+            best = score;
+            if(score > alpha){
+                alpha = score;
+                if(alpha >= beta) return best;
+            }
+        }
+    }
+    if(best == -65){
+        if(passed) return final_discs(p, o);
+        return -solve_last(o, p, -beta, -alpha, squares, n, true);
+    }
+    return best;
+}
+
+/**
+ * @brief 打てる手を読む順にlistへ並べる
+ * @param[out] int 手の数
+ */
+inline int EndgameSolver::order_moves(const Bitboard p, const Bitboard o, Bitboard moves, const int tt_move, int *list) const {
+    const Bitboard odd = odd_quadrants(~(p | o));
+    const bool fastest_first = popcount(~(p | o)) >= 7;
+    int n = 0;
+    int key[64];
+    for(; moves; moves &= moves - 1){
+        const int sq = first_square(moves);
+        int k;
+        if(sq == tt_move) k = 1 << 20;
+        else if(!fastest_first) k = static_cast<int>((odd >> sq) & 1);
+        else{
+            const Bitboard f = get_flips(p, o, sq);
+            const Bitboard np = o ^ f, no = p | f | (Bitboard(1) << sq);
+            const Bitboard m = get_moves(np, no);
+            const Bitboard e = ~(np | no);
+            const Bitboard around = shift<1>(no) | shift<-1>(no) | shift<8>(no) | shift<-8>(no) | shift<9>(no) | shift<-9>(no) | shift<7>(no) | shift<-7>(no);
+            k = -(popcount(m) + popcount(m & 0x8100000000000081ull))*16 - popcount(around & e)*2 + static_cast<int>((odd >> sq) & 1)*4;
+        }
+        int i = n++;
+        for(; i > 0 && key[i - 1] < k; i--){
+            key[i] = key[i - 1];
+            list[i] = list[i - 1];
+        }
+        key[i] = k;
+        list[i] = sq;
+    }
+    return n;
+}
+
+/**
+ * @brief 石差を求める
+ * @param[in] p 手番側の石, o 相手の石, passed 直前がパスか
+ * @details fail-softなので，返り値がalpha以下なら上界，beta以上なら下界．
+ */
+inline int EndgameSolver::solve(const Bitboard p, const Bitboard o, int alpha, int beta, const bool passed){
+    const Bitboard empty = ~(p | o);
+    const int empties = popcount(empty);
+    if(empties <= 4){
+        if(empties == 0) return popcount(p) - popcount(o);
+        // 奇数個の象限の空きを先に並べる
+        const Bitboard odd = odd_quadrants(empty);
+        int squares[4], n = 0;
+        for(Bitboard e = empty & odd; e; e &= e - 1) squares[n++] = first_square(e);
+        for(Bitboard e = empty & ~odd; e; e &= e - 1) squares[n++] = first_square(e);
+        return solve_last(p, o, alpha, beta, squares, n, passed);
+    }
+    nodes++;
+    const Bitboard moves = get_moves(p, o);
+    if(moves == 0){
+        if(passed) return final_discs(p, o);
+        return -solve(o, p, -beta, -alpha, true);
+    }
+
+    if(empties >= 8){
+        // 相手の確定石は取り返せないので，石差の上限がalpha以下なら読まなくてよい
+        const int upper = 64 - 2*popcount(stable_discs(p, o));
+        if(upper <= alpha) return upper;
+        if(upper < beta) beta = upper;
+    }
+
+    const bool use_tt = empties >= 8;
+    std::uint64_t key = 0;
+    int tt_move = 64;
+    if(use_tt){
+        key = hash_position(p, o);
+        TTData t;
+        tt_probes++;
+        if(tt.probe(key, t)){
+            tt_hits++;
+            tt_move = t.move;
+            if(t.depth >= empties){
+                const int score = t.score / disc_value;
+                if(t.bound == Bound::exact) return score;
+                if(t.bound == Bound::lower && score >= beta) return score;
+                if(t.bound == Bound::upper && score <= alpha) return score;
+                if(t.bound == Bound::lower) alpha = std::max(alpha, score);
+                if(t.bound == Bound::upper) beta = std::min(beta, score);
+            }
+        }
+    }
+
+    int list[64];
+    const int n = order_moves(p, o, moves, tt_move, list);
+    const int alpha0 = alpha;
+    int best = -65, best_move = list[0];
+    for(int i = 0; i < n; i++){
+        const int sq = list[i];
+        const Bitboard f = get_flips(p, o, sq);
+        const Bitboard np = o ^ f, no = p | f | (Bitboard(1) << sq);
+        int score;
+        if(i == 0) score = -solve(np, no, -beta, -alpha, false);
+        else{
+            // 2手目以降はまずalphaを超えるかだけを窓の幅1で調べ，超えたら読み直す
+            score = -solve(np, no, -alpha - 1, -alpha, false);
+            if(score > alpha && score < beta) score = -solve(np, no, -beta, -score, false);
+        }
+        if(score > best){
+            best = score;
+            best_move = sq;
+            if(score > alpha){
+                alpha = score;
+                if(alpha >= beta) break;
+            }
+        }
+    }
+    if(use_tt){
+        const Bound bound = best >= beta ? Bound::lower : (best > alpha0 ? Bound::exact : Bound::upper);
+        tt.store(key, best*disc_value, empties, bound, best_move);
+    }
+    return best;
+}
+
+/**
+ * @brief 完全読みで最善手と石差を求める
+ * @param[in] threads スレッド数
+ * @details 最初の手は主スレッドで全幅で読み，残りの手をスレッドで分けて読む(根でのYBWC)．
+ *          2手目以降はそれまでの最善の石差をalphaにして読み，alphaを超えた手だけが正確な値を返すので，その最大が答え．
+ *          置換表は全スレッドで共有する．scoreの単位はSearcherと同じ(石差×disc_value)．
+ */
+inline SearchResult solve_endgame(TranspositionTable &tt, const int threads, const Bitboard p, const Bitboard o){
+    const auto start = std::chrono::steady_clock::now();
+    tt.new_search();
+    SearchResult result;
+    result.depth = 64 - popcount(p | o);
+    Bitboard moves = get_moves(p, o);
+    if(moves == 0){ // パス
+        EndgameSolver solver(tt);
+        result.score = -solver.solve(o, p, -64, 64, true)*disc_value;
+        result.nodes = solver.node_count();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    std::vector<EndgameSolver> solvers(std::max(1, threads), EndgameSolver(tt));
+    int list[64];
+    TTData t;
+    const int n = solvers[0].order_moves(p, o, moves, tt.probe(hash_position(p, o), t) ? t.move : 64, list);
+    auto child = [&](const int i, Bitboard &np, Bitboard &no){
+        const Bitboard f = get_flips(p, o, list[i]);
+        np = o ^ f;
+        no = p | f | (Bitboard(1) << list[i]);
+    };
+    Bitboard np, no;
+    child(0, np, no);
+    int best = -solvers[0].solve(np, no, -64, 64, false);
+    int best_move = list[0];
+
+    std::atomic<int> next(1);
+    std::atomic<int> alpha(best);
+    std::mutex m;
+    auto work = [&](EndgameSolver &solver){
+        for(int i; (i = next.fetch_add(1)) < n; ){
+            Bitboard cp, co;
+            child(i, cp, co);
+            const int a = alpha.load();
+            const int score = -solver.solve(cp, co, -64, -a, false);
+            if(score > a){
+                std::lock_guard<std::mutex> lock(m);
+                if(score > best){
+                    best = score;
+                    best_move = list[i];
+                    alpha.store(best);
+                }
+            }
+        }
+    };
+    std::vector<std::thread> helpers;
+    for(int t = 1; t < static_cast<int>(solvers.size()); t++) helpers.emplace_back(work, std::ref(solvers[t]));
+    work(solvers[0]);
+    for(auto&& t : helpers) t.join();
+
+    result.move = best_move;
+    result.score = best*disc_value;
+    for(auto&& s : solvers){
+        result.nodes += s.node_count();
+        result.tt_probes += s.probe_count();
+        result.tt_hits += s.hit_count();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    tt.store(hash_position(p, o), result.score, result.depth, Bound::exact, best_move);
+    return result;
+}
@@ -2,6 +2,25 @@
  * @file main.cpp
  * @brief Othello
  * @author yuto-te
+ * @details ./a.out --perft 9 で初期局面からの局面数をmake_move/undo_moveと局面のコピーの両方で数え，一致するかと速度を表示する．
+ *          ./a.out --black engine --white human --time 2 --tt 256 で黒をコンピュータにする．
+ *          --timeは1手の持ち時間(秒)，--ttは置換表の大きさ(MB)，--depthは最大の深さ．
+ *          コンピュータが打つたびに読んだ深さ，nodes/sec，置換表のヒット率を表示する．
+ *          --threads Nで置換表を共有するN本のスレッドで探索する(Lazy SMP)．
+ *          --black mcts のようにmctsを指定するとモンテカルロ木探索で打つ．--uct-cはUCB1の探索の係数(デフォルト1.4)，
+ *          --arenaは木のノードに使う領域の大きさ(MB)．打つたびにrollouts/secと選んだ手の勝率を表示する．
+ *          ./a.out --match engine:depth=6 mcts:time=0.02 --games 2000 で画面を使わずに全コアで対戦し，
+ *          1人目から見たEloと95%信頼区間，games/secを表示する．--sprt 0 5 でSPRT(elo0=0, elo1=5)が決まったら止める．
+ *          序盤は--opening 8手ランダムに打ち，同じ序盤で色を入れ替えて2局ずつ打つ．--seedで序盤が変わる．
+ *          対戦では--tt(MB)を全スレッドの対局者で分けて使う．--record FILEで対戦の棋譜をFILEに追記する．
+ *          対局の棋譜は終局したときに日時の名前の.recファイルへバイナリ形式(record.hpp)で書く．
+ *          ./a.out --train FILE weights.bin --epochs 10 --rate 0.005 で棋譜からパターンの重みを学習し，--eval weights.bin で使う．
+ *          ./a.out --build-book FILE book.bin --book-plies 12 --depth 10 --threads 64 で棋譜の12手目までの局面を深さ10で読んで定石を作り，
+ *          --book book.bin で使う(--book-minで棋譜に出た回数が少ない局面を除く)．対戦ではbook=book.binで指定する．
+ *          ./a.out --replay FILE で棋譜ファイルの全対局を並べ直して確かめ，対局数，手数，勝敗，games/secを表示する．
+ *          空きマスが--solveで指定した数(デフォルト20)以下になったら完全読みで打つ．
+ *          ./a.out --bench-endgame 20 --threads 4 で空きマス20の決まった局面の組を完全読みし，時間を表示する．
+ *          ./a.out --bench-smp --threads 64 --depth 12 で決まった局面の組を深さ12まで読む時間を1, 2, 4, ..., 64スレッドで測り，速度向上率を表示する．
  */
 
 #include <iostream>
@@ -10,138 +29,79 @@
 #include <sstream>      // stringstream
 #include <unistd.h>     // sleep
 #include <vector>
+#include <chrono>
+#include <string>
 
-constexpr int L = 10; // オセロの格子のサイズ，境界用に一回り大きくとっている
+#include "bitboard.hpp"
+#include "book.hpp"
+#include "endgame.hpp"
+#include "mcts.hpp"
+#include "parallel.hpp"
+#include "position.hpp"
+#include "record.hpp"
+#include "search.hpp"
+#include "tournament.hpp"
+#include "trainer.hpp"
+
+constexpr int N = 8; // オセロの盤の一辺
 
 class Othello{
 private:
-    std::array< std::array<int, L>, L > board;
-    int turn, not_turn; // 手番の色を管理
+    Position pos; // 盤面と手番
     bool pass1, pass2; // 連続するパスの管理
-    std::vector< std::vector<int> > list_can_put; // 石を置ける座標のリスト
+    Bitboard can_put; // 石を置けるマスの集合
+    GameRecord record; // 棋譜
     std::string filename; // 出力ファイル名
-    int check(const int x, const int y, const int p, const int q);
-    bool check_around(const int x, const int y);
-    void turn_over(const int x, const int y, const int p, const int q, const int reverse);
 public:
     Othello();
     void update(const int x, const int y);
     void print();
-    void write_file();
+    bool write_file();
     void search();
     bool pass_check();
     std::array<int, 2> next_stone();
     bool end_of_game();
+    bool if_put(const int x, const int y) const;
+    std::array<Bitboard, 2> bitboards() const;
+    int get_turn() const { return pos.side(); }
 };
 
 Othello::Othello()
-    : turn(1) // 黒が先攻
-    , not_turn(2) // 白が後攻
-    , pass1(false)
+    : pass1(false)
     , pass2(false)
+    , can_put(0)
 {
-    for(int x = 0; x < L; x++){
-        for(int y = 0; y < L; y++){
-            board[x][y] = 0;
-        }
-    }
-    board[4][4] = board[5][5] = 1;
-    board[5][4] = board[4][5] = 2;
-
     // 現在時刻をファイル名としてログをとる
     time_t t = time(nullptr);
     const tm* now_time = localtime(&t);
     std::stringstream s;
     s<<"20";
-    s<<now_time->tm_year-100 <<now_time->tm_mon+1 <<now_time->tm_mday << now_time->tm_hour << now_time->tm_min << now_time->tm_sec << ".dat";
+    s<<now_time->tm_year-100 <<now_time->tm_mon+1 <<now_time->tm_mday << now_time->tm_hour << now_time->tm_min << now_time->tm_sec << ".rec";
     filename = s.str();
 }
 
 /**
- * @brief 石を置いたときにある方向についてひっくり返る石の個数を返す
- * @param[in] x, y: 置いた石の座標, p, q: チェックする方向
- * @param[out] reverse: ひっくり返る個数
- */
-int Othello::check(const int x, const int y, const int p, const int q){
-    int i = x + p, j = y + q;
-    int reverse = 0;
-    while(i >= 0 && i < L && j >= 0 && j < L){
-        if(board[i][j] == 0){
-            reverse = 0;
-            break;
-        }
-        else if(board[i][j] == turn) break;
-        else reverse++;
-        i += p;
-        j += q;
-    }
-    return reverse;
-}
-
-/**
- * @brief 石を置いたときにある方向について指定した個数石をひっくり返す
- * @param[in] x, y: 置いた石の座標, p, q: チェックする方向, reverse: ひっくり返す個数
- */
-void Othello::turn_over(const int x, const int y, const int p, const int q, const int reverse){
-    int i = x, j = y;
-    for(int n = 0; n <= reverse; n++){
-        board[i][j] = turn;
-        i += p;
-        j += q;
-    }
-}
-
-/**
- * @brief ひっくり返る医師の個数を調べて，ひっくり返す
+ * @brief 石を置いてひっくり返し，手番を交代する
  */
 void Othello::update(const int x, const int y){
-    std::array<int, 3> a = {-1, 0, 1};
-    for(int i = 0; i < 3; i++){
-        for(int j = 0; j < 3; j++){
-            if(i == 1 && j == 1) continue;
-            int reverse = check(x, y, a[i], a[j]);
-            turn_over(x, y, a[i], a[j], reverse);
-        }
-    }
-    std::swap(turn, not_turn);
+    pos.make_move(square(x, y));
+    record.push(square(x, y));
+    pass1 = pass2 = false;
 }
 
 /**
- * @brief 周囲8方向でひっくり返すことのできる石の個数の合計を求めて，0でないか調べる
+ * @brief 石のおける場所の集合を求める
  */
-bool Othello::check_around(const int x, const int y){
-    std::array<int, 3> a = {-1, 0, 1};
-    int reverse = 0;
-    for(int i = 0; i < 3; i++){
-        for(int j = 0; j < 3; j++){
-            if(i == 1 && j == 1) continue;
-            reverse += check(x, y, a[i], a[j]);
-        }
-    }
-    if(reverse == 0) return false;
-    else return true;
+void Othello::search(){
+    can_put = pos.moves();
 }
 
-/**
- * @brief 石のおける場所のリストを返す
- */
-void Othello::search(){
-    std::vector< std::vector<int> > can_put;
-    for(int x = 1; x < L - 1; x++){
-        for(int y = 1; y < L - 1; y++){
-            if(board[x][y] == 0){
-                if(check_around(x, y)) can_put.push_back({x, y});
-            }
-        }
-    }
-    list_can_put = can_put; // 石を置ける座標のリスト
-} // 出力ファイル名
 /**
  * @brief 打てる場所がなければパスする，パスが連続で続くかも判定する
  */
 bool Othello::pass_check(){
-    if(list_can_put.size() == 0){ // 石を置ける座標のリスト
-        std::swap(turn, not_turn); // 出力ファイル名
+    if(can_put == 0){
+        pos.make_pass();
         if(pass1) pass2 = true;
         else pass1 = true;
         return true;
@@ -160,15 +120,9 @@ bool Othello::end_of_game(){
 /**
  * @brief 入力した座標に石を置けるか判定する
  */
-bool if_put(const int x, const int y, const std::vector< std::vector<int> > &can_put){
-    bool flag = false;
-    for(auto&& coordinate : can_put){
-        if(x == coordinate[0] && y == coordinate[1]){
-            flag = true;
-            break;
-        }
-    }
-    return flag;
+bool Othello::if_put(const int x, const int y) const {
+    if(x < 1 || x > N || y < 1 || y > N) return false;
+    return (can_put >> square(x, y)) & 1;
 }
 
 /**
@@ -178,18 +132,19 @@ void Othello::print(){
     std::cout << " ＡＢＣＤＥＦＧＨ" << std::endl;
     int black = 0;
     int white = 0;
-    for(int x = 1; x < L - 1; x++){
+    for(int x = 1; x <= N; x++){
         std::cout << x;
-        for(int y = 1; y < L - 1; y++){
-            if(board[x][y] == 1){
+        for(int y = 1; y <= N; y++){
+            const int c = pos.at(square(x, y));
+            if(c == 1){
                 std::cout << "○";
                 black++;
             }
-            else if(board[x][y] == 2){
+            else if(c == 2){
                 std::cout << "●";
                 white++;
             }
-            else if(if_put(x, y, list_can_put)){ // 石を置ける座標のリスト
+            else if(if_put(x, y)){
                 std::cout << "　"; // 出力ファイル名
             }
             else std::cout << "・";
@@ -200,35 +155,19 @@ void Othello::print(){
 }
 
 /**
- * @brief 途中経過をファイルに保存する
+ * @brief 終局した対局の棋譜をファイルに追記する
+ * @details record.hppのバイナリ形式で，1局を手数+2バイトで書く．--replayで読み直せる．
+ * @return ファイルを開けたらtrue
  */
-void Othello::write_file(){
-    std::ofstream writing_file;
-    writing_file.open(filename, std::ios::app);
-    writing_file << "  A B C D E F G H" << std::endl;
-    int black = 0;
-    int white = 0;
-    for(int x = 1; x < L - 1; x++){
-        writing_file << x;
-        for(int y = 1; y < L - 1; y++){
-            if(board[x][y] == 1){
-                writing_file << " o";
-                black++;
-            }
-            else if(board[x][y] == 2){
-                writing_file << " #";
-                white++;
-            }
-            else if(if_put(x, y, list_can_put)){ // 石を置ける座標のリスト
-                writing_file << "  "; // 出力ファイル名
-            }
-            else writing_file << " .";
-        }
-        writing_file << std::endl;
+bool Othello::write_file(){
+    record.result = static_cast<std::int8_t>(final_discs(pos.black(), pos.white()));
+    RecordWriter writer(filename);
+    if(!writer.good()){
+        std::cerr << "cannot write " << filename << std::endl;
+        return false;
     }
-    writing_file << "黒 " << black << "   " << "白 " << white << std::endl;
-    writing_file << std::endl;
-    writing_file.close();
+    writer.write(record);
+    return true;
 }
 
 /**
@@ -249,17 +188,309 @@ std::array<int, 2> Othello::next_stone(){
     int x, y;
     pass1 = pass2 = false;
     while(true){
-        if(turn == 1) std::cout << "黒";
+        if(pos.side() == 1) std::cout << "黒";
         else std::cout << "白";
         std::cin >> x >> c;
         y = alphabetToNumber(c);
-        if(if_put(x, y, list_can_put)) break; // 石を置ける座標のリスト
+        if(if_put(x, y)) break;
         std::cout << "wrong place, again" << std::endl; // 出力ファイル名
     }
     return {x, y};
 }
 
-int main(){
+/**
+ * @brief 盤面を手番側と相手側のビットボードにする
+ */
+std::array<Bitboard, 2> Othello::bitboards() const {
+    return {pos.player(), pos.opponent()};
+}
+
+/**
+ * @brief make_move/undo_moveと局面のコピーで深さ1からmax_depthまでの局面数を数えて比べる
+ */
+int perft_driver(const int max_depth){
+    Position pos;
+    const Bitboard b[2] = {pos.player(), pos.opponent()};
+    bool ok = true;
+    for(int depth = 1; depth <= max_depth; depth++){
+        auto start = std::chrono::steady_clock::now();
+        const long long undo_nodes = perft(pos, depth);
+        const double undo_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        const long long copy_nodes = perft(b[0], b[1], depth);
+        const double copy_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "depth " << depth << "  make/undo " << undo_nodes << " (" << undo_nodes / undo_sec << " nodes/sec)"
+                  << "  copy " << copy_nodes << " (" << copy_nodes / copy_sec << " nodes/sec)"
+                  << "  ratio " << undo_sec / copy_sec << (undo_nodes == copy_nodes ? "" : "  MISMATCH") << std::endl;
+        if(undo_nodes != copy_nodes) ok = false;
+    }
+    return ok ? 0 : 1;
+}
+
+/**
+ * @brief 手を決めるもの
+ */
+enum class Player{ human, engine, mcts };
+
+/**
+ * @brief 名前から手を決めるものを選ぶ
+ * @param[out] bool 知っている名前か
+ */
+bool player_from_name(const std::string &name, Player &player){
+    if(name == "human") player = Player::human;
+    else if(name == "engine") player = Player::engine;
+    else if(name == "mcts") player = Player::mcts;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief コンピュータの手を探す
+ * @param[out] report 探索の結果の表示
+ */
+std::array<int, 2> engine_stone(const Othello &game, ParallelSearcher &searcher, TranspositionTable &tt, const OpeningBook &book, const double seconds, const int max_depth, const int solve_empties, std::string &report){
+    const auto b = game.bitboards();
+    int move, score, depth;
+    if(book.probe(b[0], b[1], move, score, depth)){
+        const int x = move / 8 + 1, y = move % 8 + 1;
+        std::stringstream s;
+        s << (game.get_turn() == 1 ? "黒 " : "白 ") << x << static_cast<char>('A' + y - 1) << "  book  depth " << depth << "  score " << score;
+        report = s.str();
+        return {x, y};
+    }
+    const bool solve = 64 - popcount(b[0] | b[1]) <= solve_empties;
+    const SearchResult r = solve ? solve_endgame(tt, searcher.size(), b[0], b[1]) : searcher.search(b[0], b[1], seconds, max_depth);
+    const int x = r.move / 8 + 1, y = r.move % 8 + 1;
+    std::stringstream s;
+    s << (game.get_turn() == 1 ? "黒 " : "白 ") << x << static_cast<char>('A' + y - 1)
+      << (solve ? "  solved " : "  depth ") << r.depth << "  score " << r.score << "  threads " << searcher.size()
+      << "  " << static_cast<long long>(r.nodes / std::max(r.seconds, 1e-9)) << " nodes/sec"
+      << "  TT hit " << (r.tt_probes ? 100.*r.tt_hits / r.tt_probes : 0.) << "%";
+    report = s.str();
+    return {x, y};
+}
+
+/**
+ * @brief 初期局面からランダムに打ってベンチマーク用の局面を作る
+ * @param[in] plies 打つ手数, seed 乱数の種
+ * @details 途中で終局したらそこで止める．パスは手数に数えない．
+ */
+std::array<Bitboard, 2> random_position(const int plies, std::uint64_t seed){
+    const Position start;
+    Bitboard p = start.player(), o = start.opponent();
+    for(int ply = 0; ply < plies; ){
+        Bitboard moves = get_moves(p, o);
+        if(moves == 0){
+            if(get_moves(o, p) == 0) break;
+            std::swap(p, o);
+            continue;
+        }
+        for(int k = static_cast<int>(splitmix64(seed) % popcount(moves)); k > 0; k--) moves &= moves - 1;
+        const int sq = first_square(moves);
+        const Bitboard f = get_flips(p, o, sq);
+        const Bitboard next_p = o ^ f;
+        o = p | f | (Bitboard(1) << sq);
+        p = next_p;
+        ply++;
+    }
+    return {p, o};
+}
+
+/**
+ * @brief 並列探索のスケーリングを測る
+ * @details 決まった局面の組をスレッド数1, 2, 4, ..., max_threadsで深さdepthまで読み，合計時間と1スレッドに対する速度向上率を表示する．
+ *          測るたびに置換表を空にする．
+ */
+int bench_smp(const int max_threads, const int depth, const std::size_t tt_size){
+    std::vector< std::array<Bitboard, 2> > positions;
+    for(int i = 0; i < 8; i++) positions.push_back(random_position(12 + 4*i, 0x5eed + i));
+    TranspositionTable tt(tt_size);
+    double base = 0.;
+    for(int threads = 1; ; threads = std::min(threads*2, max_threads)){
+        ParallelSearcher searcher(tt, threads);
+        double sec = 0.;
+        long long nodes = 0;
+        for(auto&& b : positions){
+            tt.clear();
+            const SearchResult r = searcher.search(b[0], b[1], 1e6, depth);
+            sec += r.seconds;
+            nodes += r.nodes;
+        }
+        if(threads == 1) base = sec;
+        std::cout << "threads " << threads << "  time " << sec << " sec  speedup " << base / sec
+                  << "  " << static_cast<long long>(nodes / sec) << " nodes/sec" << std::endl;
+        if(threads >= max_threads) break;
+    }
+    return 0;
+}
+
+/**
+ * @brief 完全読みの速さを測る
+ * @details ランダムに打って空きマスがemptiesになった局面を8つ作り，それぞれの石差，ノード数，時間を表示する．
+ */
+int bench_endgame(const int empties, const int threads, const std::size_t tt_size){
+    TranspositionTable tt(tt_size);
+    double total = 0.;
+    for(int i = 0; i < 8; i++){
+        const auto b = random_position(60 - empties, 0xe9d + i);
+        if(64 - popcount(b[0] | b[1]) != empties) continue; // 途中で終局した
+        tt.clear();
+        const SearchResult r = solve_endgame(tt, threads, b[0], b[1]);
+        total += r.seconds;
+        std::cout << "position " << i << "  empties " << r.depth << "  move " << r.move / 8 + 1 << static_cast<char>('A' + r.move % 8)
+                  << "  score " << r.score / disc_value << "  nodes " << r.nodes << "  time " << r.seconds << " sec  "
+                  << static_cast<long long>(r.nodes / std::max(r.seconds, 1e-9)) << " nodes/sec" << std::endl;
+    }
+    std::cout << "total " << total << " sec" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief モンテカルロ木探索で手を探す
+ * @param[out] report 探索の結果の表示
+ */
+std::array<int, 2> mcts_stone(const Othello &game, MctsPlayer &player, const double seconds, std::string &report){
+    const auto b = game.bitboards();
+    const MctsResult r = player.search(b[0], b[1], seconds);
+    const int x = r.move / 8 + 1, y = r.move % 8 + 1;
+    std::stringstream s;
+    s << (game.get_turn() == 1 ? "黒 " : "白 ") << x << static_cast<char>('A' + y - 1)
+      << "  mcts  win " << 100.*r.win_rate << "%  " << r.rollouts << " rollouts  "
+      << static_cast<long long>(r.rollouts / std::max(r.seconds, 1e-9)) << " rollouts/sec  nodes " << r.nodes;
+    report = s.str();
+    return {x, y};
+}
+
+/**
+ * @brief 棋譜ファイルの全対局を並べ直す
+ */
+int replay_file(const std::string &filename){
+    RecordReader reader(filename);
+    if(!reader.good()){
+        std::cerr << "cannot read " << filename << std::endl;
+        return 1;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    GameRecord g;
+    long long games = 0, plies = 0, broken = 0;
+    std::array<long long, 3> results = {0, 0, 0}; // 黒勝ち，引き分け，白勝ち
+    while(reader.next(g)){
+        games++;
+        if(!replay(g, [&](const Position&, int){ plies++; })) broken++;
+        results[g.result > 0 ? 0 : (g.result == 0 ? 1 : 2)]++;
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "games " << games << "  plies " << plies << "  black " << results[0] << " draw " << results[1] << " white " << results[2]
+              << "  broken " << broken << "  " << games / std::max(sec, 1e-9) << " games/sec" << std::endl;
+    return broken ? 1 : 0;
+}
+
+int main(int argc, char *argv[]){
+    std::array<Player, 3> players = {Player::human, Player::human, Player::human}; // 色ごとに手を決めるもの
+    double seconds = 1.;
+    int max_depth = 60;
+    std::size_t tt_size = 64;
+    std::size_t arena_size = 64;
+    double exploration = 1.4;
+    int threads = 1;
+    int solve_empties = 20;
+    int bench_empties = 0;
+    bool bench = false;
+    bool match = false;
+    MatchConfig config;
+    TrainConfig train;
+    std::string eval_file;
+    std::string book_file;
+    BookConfig book_config;
+    config.threads = std::max(1u, std::thread::hardware_concurrency()); // 対戦はデフォルトで全コアを使う
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if(arg == "--perft" && i + 1 < argc) return perft_driver(std::stoi(argv[++i]));
+        else if((arg == "--black" || arg == "--white") && i + 1 < argc){
+            if(!player_from_name(argv[++i], players[arg == "--black" ? 1 : 2])){
+                std::cerr << "unknown player " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "--uct-c" && i + 1 < argc) exploration = std::stod(argv[++i]);
+        else if(arg == "--arena" && i + 1 < argc) arena_size = std::stoul(argv[++i]);
+        else if(arg == "--time" && i + 1 < argc) seconds = std::stod(argv[++i]);
+        else if(arg == "--depth" && i + 1 < argc) max_depth = std::stoi(argv[++i]);
+        else if(arg == "--tt" && i + 1 < argc) tt_size = std::stoul(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc){
+            threads = std::max(1, std::stoi(argv[++i]));
+            config.threads = threads;
+        }
+        else if(arg == "--bench-smp") bench = true;
+        else if(arg == "--solve" && i + 1 < argc) solve_empties = std::stoi(argv[++i]);
+        else if(arg == "--bench-endgame" && i + 1 < argc) bench_empties = std::stoi(argv[++i]);
+        else if(arg == "--match" && i + 2 < argc){
+            match = true;
+            if(!parse_player(argv[i + 1], config.a) || !parse_player(argv[i + 2], config.b)){
+                std::cerr << "wrong player " << argv[i + 1] << " " << argv[i + 2] << std::endl;
+                return 1;
+            }
+            i += 2;
+        }
+        else if(arg == "--record" && i + 1 < argc) config.record = argv[++i];
+        else if(arg == "--replay" && i + 1 < argc) return replay_file(argv[++i]);
+        else if(arg == "--train" && i + 2 < argc){
+            train.records = argv[++i];
+            train.output = argv[++i];
+        }
+        else if(arg == "--epochs" && i + 1 < argc) train.epochs = std::stoi(argv[++i]);
+        else if(arg == "--rate" && i + 1 < argc) train.rate = std::stof(argv[++i]);
+        else if(arg == "--eval" && i + 1 < argc) eval_file = argv[++i];
+        else if(arg == "--book" && i + 1 < argc) book_file = argv[++i];
+        else if(arg == "--build-book" && i + 2 < argc){
+            book_config.records = argv[++i];
+            book_config.output = argv[++i];
+        }
+        else if(arg == "--book-plies" && i + 1 < argc) book_config.plies = std::stoi(argv[++i]);
+        else if(arg == "--book-min" && i + 1 < argc) book_config.min_count = std::stoi(argv[++i]);
+        else if(arg == "--games" && i + 1 < argc) config.games = std::stoi(argv[++i]);
+        else if(arg == "--opening" && i + 1 < argc) config.opening_plies = std::stoi(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc) config.seed = std::stoull(argv[++i]);
+        else if(arg == "--sprt" && i + 2 < argc){
+            config.sprt = true;
+            config.elo0 = std::stod(argv[++i]);
+            config.elo1 = std::stod(argv[++i]);
+        }
+        else{
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if(!train.records.empty()) return train_patterns(train) ? 0 : 1;
+    if(!book_config.records.empty()){
+        book_config.depth = max_depth == 60 ? book_config.depth : max_depth;
+        book_config.threads = threads;
+        book_config.megabytes = tt_size;
+        return build_book(book_config) ? 0 : 1;
+    }
+    if(match){
+        config.megabytes = tt_size;
+        return run_match(config).games() ? 0 : 1;
+    }
+    if(bench_empties > 0) return bench_endgame(bench_empties, threads, tt_size);
+    if(bench) return bench_smp(threads, max_depth == 60 ? 12 : max_depth, tt_size);
+
+    PatternWeights weights;
+    if(!eval_file.empty() && !weights.load(eval_file)){
+        std::cerr << "cannot load " << eval_file << std::endl;
+        return 1;
+    }
+    OpeningBook book;
+    if(!book_file.empty() && !book.load(book_file)){
+        std::cerr << "cannot load " << book_file << std::endl;
+        return 1;
+    }
+    TranspositionTable tt(tt_size);
+    ParallelSearcher searcher(tt, threads, weights.good() ? &weights : nullptr);
+    std::unique_ptr<MctsPlayer> mcts; // 使うときだけ領域を確保する
+    if(players[1] == Player::mcts || players[2] == Player::mcts) mcts.reset(new MctsPlayer(arena_size, threads, exploration));
+    std::string report;
     Othello game;
     std::array<int, 2> coordinate;
     while(true){
@@ -270,18 +501,22 @@ int main(){
             // 手番交代
             game.search();
             game.print();
-            game.write_file();
             std::cout << "pass" << std::endl;
             sleep(1);
             continue;
         }
         else{
             game.print();
-            game.write_file();
-            coordinate = game.next_stone();
+            if(!report.empty()) std::cout << report << std::endl;
+            const Player player = players[game.get_turn()];
+            if(player == Player::engine) coordinate = engine_stone(game, searcher, tt, book, seconds, max_depth, solve_empties, report);
+            else if(player == Player::mcts) coordinate = mcts_stone(game, *mcts, seconds, report);
+            else coordinate = game.next_stone();
             game.update(coordinate[0], coordinate[1]);
         }
     }
+    const bool written = game.write_file();
+    if(!report.empty()) std::cout << report << std::endl;
     std::cout << "end game" << std::endl;
-    return 0;
+    return written ? 0 : 1;
 }
@@ -0,0 +1,273 @@
+/**
+ * @file mcts.hpp
+ * @brief 木を共有する並列モンテカルロ木探索(UCT)
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>    // min,max
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>      // swap
+#include <vector>
+
+#include "bitboard.hpp"
+#include "position.hpp"
+
+/**
+ * @brief 探索木のノード
+ * @details winsはこのノードへ打った側から見た勝ちを2，引き分けを1として足したもの．
+ *          stateは0: 未展開，1: 展開中，2: 展開済み．first_childとn_childrenはstateを2にする前に書く．
+ */
+struct MctsNode{
+    std::atomic<int> visits;
+    std::atomic<int> wins;
+    std::atomic<int> state;
+    std::int32_t first_child;
+    std::uint8_t n_children;
+    std::uint8_t move;
+};
+
+/**
+ * @brief ノードを切り出す領域
+ * @details 前もって確保した配列の先頭から順に切り出すだけで，1つずつは解放しない．1手ごとにresetで丸ごと空にする．
+ */
+class NodeArena{
+private:
+    static constexpr std::size_t min_capacity = 1 + 64;    // 根と1回の展開(子は多くても64個)
+    std::unique_ptr<MctsNode[]> nodes;
+    std::size_t capacity;
+    std::atomic<std::size_t> top;
+public:
+    explicit NodeArena(const std::size_t megabytes);
+    void reset(){ top.store(0, std::memory_order_relaxed); }
+    int allocate(const int n);
+    MctsNode &operator[](const int i){ return nodes[i]; }
+    std::size_t size() const { return std::min(top.load(std::memory_order_relaxed), capacity); }
+};
+
+inline NodeArena::NodeArena(const std::size_t megabytes)
+    : capacity(std::max(min_capacity, megabytes*(std::size_t(1) << 20) / sizeof(MctsNode)))
+    , top(0)
+{
+    nodes.reset(new MctsNode[capacity]);
+}
+
+/**
+ * @brief n個続きのノードを切り出して初期化する
+ * @param[out] int 先頭の番号，足りなければ-1
+ */
+inline int NodeArena::allocate(const int n){
+    const std::size_t i = top.fetch_add(n, std::memory_order_relaxed);
+    if(i + n > capacity) return -1;
+    for(std::size_t j = i; j < i + n; j++){
+        nodes[j].visits.store(0, std::memory_order_relaxed);
+        nodes[j].wins.store(0, std::memory_order_relaxed);
+        nodes[j].state.store(0, std::memory_order_relaxed);
+        nodes[j].first_child = -1;
+        nodes[j].n_children = 0;
+        nodes[j].move = pass_move;
+    }
+    return static_cast<int>(i);
+}
+
+/**
+ * @brief xorshift64*
+ */
+inline std::uint64_t xorshift64(std::uint64_t &state){
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state*0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief 終局までランダムに打つ
+ * @param[out] int 手番側pから見た結果(勝ち2，引き分け1，負け0)
+ */
+inline int random_playout(Bitboard p, Bitboard o, std::uint64_t &rng){
+    bool flipped = false; // pが呼び出したときの相手側になっているか
+    bool passed = false;
+    while(true){
+        Bitboard moves = get_moves(p, o);
+        if(moves == 0){
+            if(passed) break;
+            passed = true;
+            std::swap(p, o);
+            flipped = !flipped;
+            continue;
+        }
+        passed = false;
+        for(int k = static_cast<int>(xorshift64(rng) % popcount(moves)); k > 0; k--) moves &= moves - 1;
+        const int sq = first_square(moves);
+        const Bitboard f = get_flips(p, o, sq);
+        const Bitboard next_p = o ^ f;
+        o = p | f | (Bitboard(1) << sq);
+        p = next_p;
+        flipped = !flipped;
+    }
+    const int diff = popcount(p) - popcount(o);
+    const int r = diff > 0 ? 2 : (diff == 0 ? 1 : 0);
+    return flipped ? 2 - r : r;
+}
+
+/**
+ * @brief MCTSの結果
+ */
+struct MctsResult{
+    int move = pass_move;
+    long long rollouts = 0;
+    double win_rate = 0.;   // 選んだ手の勝率(引き分けは0.5)
+    std::size_t nodes = 0;
+    double seconds = 0.;
+};
+
+/**
+ * @brief 木を共有するN本のスレッドでのUCT
+ * @details 全スレッドが1つの木を根から降り，UCB1 = 勝率 + c*sqrt(ln(親の訪問数)/訪問数)が最大の子を選ぶ．
+ *          降りるときに訪問数だけを先に足しておき(virtual loss)，勝ちはプレイアウトの後に足すので，
+ *          同時に降りている他のスレッドにはその枝が負けたように見えて別の枝に散らばる．
+ *          ノードは2回目に訪れたときに展開し，領域が足りなくなったら展開せずにプレイアウトだけ続ける．
+ *          手は訪問数が最も多い子．
+ */
+class MctsPlayer{
+private:
+    NodeArena arena;
+    int threads;
+    double c;
+    static constexpr int expand_visits = 2;
+    bool expand(MctsNode &node, const Bitboard p, const Bitboard o);
+    int select(MctsNode &node);
+    void iterate(Bitboard p, Bitboard o, std::uint64_t &rng);
+public:
+    MctsPlayer(const std::size_t megabytes, const int n_threads, const double exploration)
+        : arena(megabytes), threads(n_threads < 1 ? 1 : n_threads), c(exploration) {}
+    MctsResult search(const Bitboard p, const Bitboard o, const double seconds);
+};
+
+/**
+ * @brief 子ノードを作る
+ * @details 打てる手がなければパスの子を1つ作る．終局なら子は無し．
+ */
+inline bool MctsPlayer::expand(MctsNode &node, const Bitboard p, const Bitboard o){
+    int expected = 0;
+    if(!node.state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) return false;
+    Bitboard moves = get_moves(p, o);
+    int n = popcount(moves);
+    if(n == 0 && get_moves(o, p) != 0) n = 1;
+    const int first = n > 0 ? arena.allocate(n) : 0;
+    if(first < 0){
+        node.state.store(0, std::memory_order_release);
+        return false;
+    }
+    for(int i = 0; i < n; i++){
+        arena[first + i].move = moves ? static_cast<std::uint8_t>(first_square(moves)) : pass_move;
+        moves &= moves - 1;
+    }
+    node.first_child = first;
+    node.n_children = static_cast<std::uint8_t>(n);
+    node.state.store(2, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief UCB1が最大の子を選ぶ
+ */
+inline int MctsPlayer::select(MctsNode &node){
+    const double log_n = std::log(static_cast<double>(std::max(1, node.visits.load(std::memory_order_relaxed))));
+    int best = node.first_child;
+    double best_ucb = -1.;
+    for(int i = node.first_child; i < node.first_child + node.n_children; i++){
+        const int v = arena[i].visits.load(std::memory_order_relaxed);
+        if(v == 0) return i;
+        const double ucb = arena[i].wins.load(std::memory_order_relaxed) / (2.*v) + c*std::sqrt(log_n / v);
+        if(ucb > best_ucb){
+            best_ucb = ucb;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 根から葉まで降りて，プレイアウトして結果を戻す
+ */
+inline void MctsPlayer::iterate(Bitboard p, Bitboard o, std::uint64_t &rng){
+    int path[128];
+    int depth = 0;
+    int index = 0;
+    path[depth++] = index;
+    arena[index].visits.fetch_add(1, std::memory_order_relaxed);
+    while(true){
+        MctsNode &node = arena[index];
+        int state = node.state.load(std::memory_order_acquire);
+        if(state == 0 && (index == 0 || node.visits.load(std::memory_order_relaxed) >= expand_visits)){
+            if(expand(node, p, o)) state = 2;
+        }
+        if(state != 2 || node.n_children == 0) break;
+        index = select(node);
+        MctsNode &child = arena[index];
+        child.visits.fetch_add(1, std::memory_order_relaxed); // virtual loss
+        if(child.move != pass_move){
+            const Bitboard f = get_flips(p, o, child.move);
+            const Bitboard next_p = o ^ f;
+            o = p | f | (Bitboard(1) << child.move);
+            p = next_p;
+        }
+        else std::swap(p, o);
+        path[depth++] = index;
+    }
+    // 葉で手番の側から見た結果を，根に向かって手番を入れ替えながら足す
+    int r = random_playout(p, o, rng);
+    for(int i = depth - 1; i >= 0; i--){
+        arena[path[i]].wins.fetch_add(2 - r, std::memory_order_relaxed);
+        r = 2 - r;
+    }
+}
+
+/**
+ * @brief 持ち時間のあいだ探索して手を選ぶ
+ * @param[in] p 手番側の石, o 相手の石, seconds 持ち時間(秒)
+ */
+inline MctsResult MctsPlayer::search(const Bitboard p, const Bitboard o, const double seconds){
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    arena.reset();
+    arena.allocate(1);
+    std::atomic<long long> rollouts(0);
+    auto work = [&](const int id){
+        std::uint64_t rng = 0x9E3779B97F4A7C15ull*(id + 1) ^ static_cast<std::uint64_t>(start.time_since_epoch().count());
+        long long n = 0;
+        do{
+            for(int i = 0; i < 64; i++) iterate(p, o, rng);
+            n += 64;
+        }while(std::chrono::steady_clock::now() < deadline);
+        rollouts.fetch_add(n);
+    };
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < threads; i++) helpers.emplace_back(work, i);
+    work(0);
+    for(auto&& t : helpers) t.join();
+
+    MctsResult result;
+    const MctsNode &root = arena[0];
+    int most = -1;
+    for(int i = root.first_child; i < root.first_child + root.n_children; i++){
+        const int v = arena[i].visits.load();
+        if(v > most){
+            most = v;
+            result.move = arena[i].move;
+            result.win_rate = v ? arena[i].wins.load() / (2.*v) : 0.;
+        }
+    }
+    result.rollouts = rollouts.load();
+    result.nodes = arena.size();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file parallel.hpp
+ * @brief 置換表を共有する並列探索(Lazy SMP)
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "search.hpp"
+#include "transposition.hpp"
+
+/**
+ * @brief N本のスレッドで同じ局面を探索する
+ * @details 全スレッドが1つの置換表を共有して同じ局面を反復深化で読む．互いの結果が置換表を通して伝わるので，
+ *          補助スレッドが先に読んだ枝は主スレッドでは置換表の値で打ち切られる．主スレッドが終わったらstopを立てて補助スレッドを止める．
+ *          結果は読み切った深さが最も深いスレッドのもの(同じなら主スレッド)で，ノード数などは全スレッドの合計．
+ */
+class ParallelSearcher{
+private:
+    TranspositionTable &tt;
+    int threads;
+    const PatternWeights *weights;
+public:
+    ParallelSearcher(TranspositionTable &table, const int n_threads, const PatternWeights *w = nullptr)
+        : tt(table), threads(n_threads < 1 ? 1 : n_threads), weights(w) {}
+    int size() const { return threads; }
+    SearchResult search(const Bitboard p, const Bitboard o, const double seconds, const int max_depth = 60);
+};
+
+inline SearchResult ParallelSearcher::search(const Bitboard p, const Bitboard o, const double seconds, const int max_depth){
+    tt.new_search();
+    std::atomic<bool> stop(false);
+    std::vector<Searcher> searchers;
+    searchers.reserve(threads);
+    for(int i = 0; i < threads; i++) searchers.emplace_back(tt, &stop, i, weights);
+    std::vector<SearchResult> results(threads);
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < threads; i++){
+        helpers.emplace_back([&, i](){ results[i] = searchers[i].search(p, o, seconds, max_depth); });
+    }
+    results[0] = searchers[0].search(p, o, seconds, max_depth);
+    stop.store(true, std::memory_order_relaxed);
+    for(auto&& t : helpers) t.join();
+
+    SearchResult best = results[0];
+    for(int i = 1; i < threads; i++){
+        if(results[i].depth > best.depth){
+            best.move = results[i].move;
+            best.score = results[i].score;
+            best.depth = results[i].depth;
+        }
+        best.nodes += results[i].nodes;
+        best.tt_probes += results[i].tt_probes;
+        best.tt_hits += results[i].tt_hits;
+    }
+    return best;
+}
@@ -0,0 +1,281 @@
+/**
+ * @file pattern_eval.hpp
+ * @brief パターンによる評価関数
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>      // memcmp
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap,munmap
+#include <sys/stat.h>   // fstat
+#include <unistd.h>     // close
+
+#include "bitboard.hpp"
+#include "position.hpp"
+
+/**
+ * @brief パターンの種類と，盤上に置いたときの位置の表
+ * @details 種類は横縦の2, 3, 4行目，長さ8から4の斜め，辺と2つのXマス，隅の3×3，隅の2×5．
+ *          基本形を盤の8通りの対称で写し，同じマスの組になったものは1つにまとめる．同じ種類の位置は重みを共有する．
+ *          各位置の番号はマスの状態(0: 空き, 1: 色1, 2: 色2)を3進数で並べたもの．
+ */
+struct PatternSet{
+    static constexpr int max_per_square = 16;
+    struct Ref{
+        std::uint8_t instance;
+        std::uint16_t power; // このマスの桁の3のべき
+    };
+    std::vector<int> type_size;                 // 種類ごとの3^マス数
+    std::vector<int> type_offset;               // 重みの表の中の種類の先頭(先頭の1つはバイアス)
+    std::vector<int> instance_type;             // 位置ごとの種類
+    std::vector< std::vector<int> > instance_squares;
+    std::array< std::array<Ref, max_per_square>, 64 > refs; // マスごとに，それを含む位置と桁
+    std::array<int, 64> n_refs;
+    int table_size;                             // 1つの段階の重みの数
+    std::vector<std::uint16_t> swap;            // 色1と色2を入れ替えた番号
+    PatternSet();
+};
+
+/**
+ * @brief (x, y)を8通りの対称で写したマス
+ */
+inline int symmetric_square(const int x, const int y, const int s){
+    int a = x - 1, b = y - 1;
+    if(s & 1) a = 7 - a;
+    if(s & 2) b = 7 - b;
+    if(s & 4) std::swap(a, b);
+    return a*8 + b;
+}
+
+inline PatternSet::PatternSet(){
+    // 基本形(行, 列)
+    const std::vector< std::vector< std::array<int, 2> > > base = {
+        {{2, 1}, {2, 2}, {2, 3}, {2, 4}, {2, 5}, {2, 6}, {2, 7}, {2, 8}},
+        {{3, 1}, {3, 2}, {3, 3}, {3, 4}, {3, 5}, {3, 6}, {3, 7}, {3, 8}},
+        {{4, 1}, {4, 2}, {4, 3}, {4, 4}, {4, 5}, {4, 6}, {4, 7}, {4, 8}},
+        {{1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}, {7, 7}, {8, 8}},
+        {{1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 6}, {6, 7}, {7, 8}},
+        {{1, 3}, {2, 4}, {3, 5}, {4, 6}, {5, 7}, {6, 8}},
+        {{1, 4}, {2, 5}, {3, 6}, {4, 7}, {5, 8}},
+        {{1, 5}, {2, 6}, {3, 7}, {4, 8}},
+        {{2, 2}, {1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7}, {1, 8}, {2, 7}},
+        {{1, 1}, {1, 2}, {1, 3}, {2, 1}, {2, 2}, {2, 3}, {3, 1}, {3, 2}, {3, 3}},
+        {{1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {2, 1}, {2, 2}, {2, 3}, {2, 4}, {2, 5}},
+    };
+    n_refs.fill(0);
+    int offset = 1;
+    for(int t = 0; t < static_cast<int>(base.size()); t++){
+        int size = 1;
+        for(std::size_t i = 0; i < base[t].size(); i++) size *= 3;
+        type_size.push_back(size);
+        type_offset.push_back(offset);
+        offset += size;
+        std::vector<Bitboard> seen;
+        for(int s = 0; s < 8; s++){
+            std::vector<int> squares;
+            Bitboard mask = 0;
+            for(auto&& c : base[t]){
+                squares.push_back(symmetric_square(c[0], c[1], s));
+                mask |= Bitboard(1) << squares.back();
+            }
+            if(std::find(seen.begin(), seen.end(), mask) != seen.end()) continue;
+            seen.push_back(mask);
+            const int instance = static_cast<int>(instance_type.size());
+            instance_type.push_back(t);
+            instance_squares.push_back(squares);
+            int power = 1;
+            for(const int sq : squares){
+                refs[sq][n_refs[sq]++] = {static_cast<std::uint8_t>(instance), static_cast<std::uint16_t>(power)};
+                power *= 3;
+            }
+        }
+    }
+    table_size = offset;
+    swap.resize(59049);
+    for(int i = 0; i < 59049; i++){
+        int r = 0, power = 1;
+        for(int j = i; j > 0; j /= 3, power *= 3){
+            const int d = j % 3;
+            r += (d == 0 ? 0 : 3 - d)*power;
+        }
+        swap[i] = static_cast<std::uint16_t>(r);
+    }
+}
+
+/**
+ * @brief パターンの表(1つだけ作る)
+ */
+inline const PatternSet &patterns(){
+    static const PatternSet set;
+    return set;
+}
+
+constexpr int n_phases = 15; // 評価の段階の数．打った手数4手ごと
+
+/**
+ * @brief 局面の段階
+ */
+inline int phase_of(const int empties){
+    return std::min(n_phases - 1, std::max(0, (60 - empties) / 4));
+}
+
+/**
+ * @brief パターンの番号を持つ局面
+ * @details make_move/undo_moveで打ったマスと返った石を含む位置の番号だけを足し引きする．
+ *          番号の色はPositionの色(turn)で，色1が黒とは限らない．
+ */
+class EvalPosition : public Position{
+private:
+    std::array<std::uint16_t, 64> index; // 位置の数は64より少ない
+    void init();
+    void apply(const int sq, const Bitboard flips, const int color, const int sign);
+public:
+    EvalPosition() : Position() { init(); }
+    EvalPosition(const Bitboard player, const Bitboard opponent, const int side) : Position(player, opponent, side) { init(); }
+    int instance_index(const int i) const { return index[i]; }
+    void make_move(const int sq);
+    void undo_move();
+};
+
+/**
+ * @brief 番号をはじめから求める
+ */
+inline void EvalPosition::init(){
+    const PatternSet &ps = patterns();
+    index.fill(0);
+    for(std::size_t i = 0; i < ps.instance_squares.size(); i++){
+        int power = 1;
+        for(const int sq : ps.instance_squares[i]){
+            index[i] += static_cast<std::uint16_t>(at(sq)*power);
+            power *= 3;
+        }
+    }
+}
+
+/**
+ * @brief colorがsqに打ってflipsを返したぶんを番号に足す(sign = 1)か引く(sign = -1)
+ */
+inline void EvalPosition::apply(const int sq, Bitboard flips, const int color, const int sign){
+    const PatternSet &ps = patterns();
+    for(int k = 0; k < ps.n_refs[sq]; k++){
+        index[ps.refs[sq][k].instance] += static_cast<std::uint16_t>(sign*color*ps.refs[sq][k].power);
+    }
+    const int delta = sign*(2*color - 3); // 3 - colorからcolorへ
+    for(; flips; flips &= flips - 1){
+        const int f = first_square(flips);
+        for(int k = 0; k < ps.n_refs[f]; k++){
+            index[ps.refs[f][k].instance] += static_cast<std::uint16_t>(delta*ps.refs[f][k].power);
+        }
+    }
+}
+
+inline void EvalPosition::make_move(const int sq){
+    const int color = side();
+    Position::make_move(sq);
+    apply(sq, last_flips(), color, 1);
+}
+
+inline void EvalPosition::undo_move(){
+    if(last_move() != pass_move) apply(last_move(), last_flips(), 3 - side(), -1);
+    Position::undo_move();
+}
+
+/**
+ * @brief 重みファイル
+ * @details 先頭は"OTHEVAL1"，uint32で段階の数と1段階の重みの数(計16バイト)．そのあとにint16の重みが段階ごとに並ぶ．
+ *          重みの単位は1/64石で，段階の先頭の1つはバイアス．ファイルはmmapで読み込み専用に写すだけで，コピーしない．
+ */
+class PatternWeights{
+private:
+    void *map;
+    std::size_t length;
+    const std::int16_t *weights;
+public:
+    PatternWeights() : map(nullptr), length(0), weights(nullptr) {}
+    ~PatternWeights();
+    PatternWeights(const PatternWeights&) = delete;
+    PatternWeights &operator=(const PatternWeights&) = delete;
+    bool load(const std::string &filename);
+    bool good() const { return weights != nullptr; }
+    int evaluate(const EvalPosition &pos) const;
+    static bool save(const std::string &filename, const std::vector<float> &w);
+};
+
+inline PatternWeights::~PatternWeights(){
+    if(map) munmap(map, length);
+}
+
+/**
+ * @brief 重みファイルを読み込む
+ * @param[out] bool 読めたか
+ */
+inline bool PatternWeights::load(const std::string &filename){
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < 16){
+        close(fd);
+        return false;
+    }
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) return false;
+    const char *p = static_cast<const char*>(m);
+    std::uint32_t phases, size;
+    std::memcpy(&phases, p + 8, 4);
+    std::memcpy(&size, p + 12, 4);
+    if(std::memcmp(p, "OTHEVAL1", 8) != 0 || phases != n_phases || size != static_cast<std::uint32_t>(patterns().table_size)
+       || static_cast<std::size_t>(st.st_size) != 16 + std::size_t(2)*phases*size){
+        munmap(m, st.st_size);
+        return false;
+    }
+    if(map) munmap(map, length);
+    map = m;
+    length = st.st_size;
+    weights = reinterpret_cast<const std::int16_t*>(p + 16);
+    return true;
+}
+
+/**
+ * @brief 手番側から見た評価値
+ * @details 予想した最終石差(1/64石単位)．手番が色2なら色を入れ替えた番号を引く．
+ */
+inline int PatternWeights::evaluate(const EvalPosition &pos) const {
+    const PatternSet &ps = patterns();
+    const std::int16_t *w = weights + static_cast<std::size_t>(phase_of(pos.empties()))*ps.table_size;
+    int sum = w[0];
+    const int n = static_cast<int>(ps.instance_type.size());
+    if(pos.side() == 1){
+        for(int i = 0; i < n; i++) sum += w[ps.type_offset[ps.instance_type[i]] + pos.instance_index(i)];
+    }
+    else{
+        for(int i = 0; i < n; i++) sum += w[ps.type_offset[ps.instance_type[i]] + ps.swap[pos.instance_index(i)]];
+    }
+    return sum;
+}
+
+/**
+ * @brief 学習した重み(石の単位)を書き出す
+ */
+inline bool PatternWeights::save(const std::string &filename, const std::vector<float> &w){
+    std::ofstream file(filename, std::ios::binary);
+    if(!file) return false;
+    const std::uint32_t phases = n_phases, size = patterns().table_size;
+    file.write("OTHEVAL1", 8);
+    file.write(reinterpret_cast<const char*>(&phases), 4);
+    file.write(reinterpret_cast<const char*>(&size), 4);
+    std::vector<std::int16_t> q(w.size());
+    for(std::size_t i = 0; i < w.size(); i++){
+        q[i] = static_cast<std::int16_t>(std::max(-32767.f, std::min(32767.f, w[i]*64.f + (w[i] >= 0 ? .5f : -.5f))));
+    }
+    file.write(reinterpret_cast<const char*>(q.data()), q.size()*sizeof(std::int16_t));
+    return file.good();
+}
@@ -0,0 +1,149 @@
+/**
+ * @file position.hpp
+ * @brief ヒープを使わない局面と着手リスト
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>      // swap
+
+#include "bitboard.hpp"
+
+constexpr int pass_move = 64; // パスを表すマス番号
+
+/**
+ * @brief 容量固定の着手リスト
+ * @details オセロの着手可能数は33を超えないので，64マスぶんの配列を持てば足りる．
+ */
+class MoveList{
+private:
+    std::array<std::uint8_t, 64> moves;
+    int n = 0;
+public:
+    MoveList() = default;
+    explicit MoveList(Bitboard mask){ for(; mask; mask &= mask - 1) moves[n++] = static_cast<std::uint8_t>(first_square(mask)); }
+    int size() const { return n; }
+    bool empty() const { return n == 0; }
+    int operator[](const int i) const { return moves[i]; }
+    const std::uint8_t *begin() const { return moves.data(); }
+    const std::uint8_t *end() const { return moves.data() + n; }
+};
+
+/**
+ * @brief 手を戻すための記録
+ */
+struct Undo{
+    Bitboard flips;
+    int square; // pass_moveならパス
+};
+
+/**
+ * @brief 盤面と手番，手を戻すためのスタック
+ * @details 石は手番側pと相手側oのビットボードで持ち，turnで手番の色(1: 黒, 2: 白)を覚える．
+ *          make_moveはひっくり返した石を固定長のスタックに積み，undo_moveはそれを取り出して戻す．
+ *          1局は60手とパスなので128手ぶんあれば溢れない．
+ */
+class Position{
+private:
+    Bitboard p, o;
+    int turn;
+    std::array<Undo, 128> stack;
+    int sp;
+public:
+    Position();
+    Position(const Bitboard player, const Bitboard opponent, const int side) : p(player), o(opponent), turn(side), sp(0) {}
+    Bitboard player() const { return p; }
+    Bitboard opponent() const { return o; }
+    Bitboard black() const { return turn == 1 ? p : o; }
+    Bitboard white() const { return turn == 1 ? o : p; }
+    int side() const { return turn; }
+    int at(const int sq) const;
+    int empties() const { return 64 - popcount(p | o); }
+    int ply() const { return sp; }
+    int last_move() const { return sp ? stack[sp - 1].square : pass_move; }
+    Bitboard last_flips() const { return sp ? stack[sp - 1].flips : 0; }
+    Bitboard moves() const { return get_moves(p, o); }
+    bool is_legal(const int sq) const { return (moves() >> sq) & 1; }
+    void make_move(const int sq);
+    void make_pass();
+    void undo_move();
+};
+
+inline Position::Position()
+    : p((Bitboard(1) << square(4, 4)) | (Bitboard(1) << square(5, 5))) // 黒が先攻
+    , o((Bitboard(1) << square(5, 4)) | (Bitboard(1) << square(4, 5)))
+    , turn(1)
+    , sp(0)
+{
+}
+
+/**
+ * @brief マスの石の色(0: 空き, 1: 黒, 2: 白)
+ */
+inline int Position::at(const int sq) const {
+    if((p >> sq) & 1) return turn;
+    if((o >> sq) & 1) return 3 - turn;
+    return 0;
+}
+
+/**
+ * @brief 石を打って手番を交代する
+ * @details 打てるマスかどうかは調べないので，is_legalかmovesで確かめてから呼ぶ．
+ */
+inline void Position::make_move(const int sq){
+    const Bitboard f = get_flips(p, o, sq);
+    stack[sp++] = {f, sq};
+    const Bitboard next_p = o ^ f;
+    o = p | f | (Bitboard(1) << sq);
+    p = next_p;
+    turn = 3 - turn;
+}
+
+/**
+ * @brief パスして手番を交代する
+ */
+inline void Position::make_pass(){
+    stack[sp++] = {0, pass_move};
+    std::swap(p, o);
+    turn = 3 - turn;
+}
+
+/**
+ * @brief 直前の手(パスを含む)を戻す
+ */
+inline void Position::undo_move(){
+    const Undo u = stack[--sp];
+    std::swap(p, o);
+    turn = 3 - turn;
+    if(u.square != pass_move){
+        p ^= u.flips | (Bitboard(1) << u.square);
+        o ^= u.flips;
+    }
+}
+
+/**
+ * @brief make_move/undo_moveで指定した深さまでの局面数を数える
+ * @details bitboard.hppのperftと同じ数え方(パスも1手，終局は葉)．
+ */
+inline long long perft(Position &pos, const int depth){
+    if(depth == 0) return 1;
+    Bitboard moves = pos.moves();
+    if(moves == 0){
+        if(get_moves(pos.opponent(), pos.player()) == 0) return 1;
+        pos.make_pass();
+        const long long nodes = perft(pos, depth - 1);
+        pos.undo_move();
+        return nodes;
+    }
+    if(depth == 1) return popcount(moves);
+    long long nodes = 0;
+    for(; moves; moves &= moves - 1){
+        pos.make_move(first_square(moves));
+        nodes += perft(pos, depth - 1);
+        pos.undo_move();
+    }
+    return nodes;
+}
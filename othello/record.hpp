@@ -0,0 +1,161 @@
+/**
+ * @file record.hpp
+ * @brief 棋譜のバイナリ形式と書き出し・読み込み
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>      // memcmp
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bitboard.hpp"
+#include "position.hpp"
+
+/**
+ * @brief 1局の棋譜
+ * @details 初期局面から打った手のマス番号を順に並べる．パスは打てる手が無いことから分かるので入れない．
+ *          resultは黒から見た最終石差(空きマスは勝った側)．
+ */
+struct GameRecord{
+    std::uint8_t n = 0;
+    std::uint8_t moves[60];
+    std::int8_t result = 0;
+    void clear(){ n = 0; result = 0; }
+    void push(const int sq){ moves[n++] = static_cast<std::uint8_t>(sq); }
+};
+
+/**
+ * @brief 棋譜ファイルの先頭
+ * @details ファイルは"OTHREC1\0"の8バイトのあとに，1局ずつ手数(1バイト)，手(手数バイト)，結果(1バイト)が並ぶ．
+ *          1局はおよそ手数+2バイト．
+ */
+constexpr char record_magic[8] = {'O', 'T', 'H', 'R', 'E', 'C', '1', '\0'};
+
+/**
+ * @brief 棋譜をまとめて書き出す
+ * @details 追記で開き，空のファイルなら先頭を書く．64KBたまるか閉じるときに書き出す．複数のスレッドから呼んでよい．
+ */
+class RecordWriter{
+private:
+    std::ofstream file;
+    std::mutex m;
+    std::vector<char> buffer;
+    static constexpr std::size_t capacity = 1 << 16;
+    void flush_locked();
+public:
+    explicit RecordWriter(const std::string &filename);
+    ~RecordWriter();
+    bool good() const { return file.good(); }
+    void write(const GameRecord &g);
+};
+
+inline RecordWriter::RecordWriter(const std::string &filename)
+    : file(filename, std::ios::binary | std::ios::app)
+{
+    file.seekp(0, std::ios::end);
+    if(file.tellp() == 0) file.write(record_magic, 8);
+    buffer.reserve(capacity + 64);
+}
+
+inline RecordWriter::~RecordWriter(){
+    std::lock_guard<std::mutex> lock(m);
+    flush_locked();
+}
+
+inline void RecordWriter::flush_locked(){
+    file.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+inline void RecordWriter::write(const GameRecord &g){
+    std::lock_guard<std::mutex> lock(m);
+    buffer.push_back(static_cast<char>(g.n));
+    buffer.insert(buffer.end(), g.moves, g.moves + g.n);
+    buffer.push_back(static_cast<char>(g.result));
+    if(buffer.size() >= capacity) flush_locked();
+}
+
+/**
+ * @brief 棋譜ファイルを先頭から順に読む
+ * @details 1MBずつ読み込んで，その中から1局ずつ切り出す．
+ */
+class RecordReader{
+private:
+    std::ifstream file;
+    std::vector<char> buffer;
+    std::size_t pos, size;
+    bool ok;
+    bool fill(const std::size_t need);
+public:
+    explicit RecordReader(const std::string &filename);
+    bool good() const { return ok; }
+    bool next(GameRecord &g);
+};
+
+inline RecordReader::RecordReader(const std::string &filename)
+    : file(filename, std::ios::binary)
+    , buffer(1 << 20)
+    , pos(0)
+    , size(0)
+    , ok(false)
+{
+    char magic[8];
+    if(file.read(magic, 8) && std::memcmp(magic, record_magic, 8) == 0) ok = true;
+}
+
+/**
+ * @brief 読み込み済みの部分がneedバイト以上になるまで読む
+ */
+inline bool RecordReader::fill(const std::size_t need){
+    if(size - pos >= need) return true;
+    std::memmove(buffer.data(), buffer.data() + pos, size - pos);
+    size -= pos;
+    pos = 0;
+    file.read(buffer.data() + size, buffer.size() - size);
+    size += static_cast<std::size_t>(file.gcount());
+    return size >= need;
+}
+
+/**
+ * @brief 次の1局
+ * @param[out] bool 読めたか(ファイルの終わりや壊れた棋譜ならfalse)
+ */
+inline bool RecordReader::next(GameRecord &g){
+    if(!ok || !fill(1)) return false;
+    const std::size_t n = static_cast<std::uint8_t>(buffer[pos]);
+    if(n > 60 || !fill(n + 2)) return ok = false;
+    g.n = static_cast<std::uint8_t>(n);
+    std::memcpy(g.moves, buffer.data() + pos + 1, n);
+    g.result = static_cast<std::int8_t>(buffer[pos + 1 + n]);
+    pos += n + 2;
+    return true;
+}
+
+/**
+ * @brief 棋譜を初期局面から並べ直す
+ * @param[in] visit 各手を打つ前の局面とその手で呼ぶ関数 visit(const Position&, int sq)
+ * @param[out] bool すべて合法手で，最後が終局で，結果が一致したか
+ * @details 打てる手が無いときは自動でパスする．
+ */
+template<class F>
+bool replay(const GameRecord &g, F &&visit){
+    Position pos;
+    for(int i = 0; i < g.n; i++){
+        if(pos.moves() == 0){
+            if(get_moves(pos.opponent(), pos.player()) == 0) return false;
+            pos.make_pass();
+        }
+        const int sq = g.moves[i];
+        if(sq >= 64 || !pos.is_legal(sq)) return false;
+        visit(static_cast<const Position&>(pos), sq);
+        pos.make_move(sq);
+    }
+    if(pos.moves() != 0 || get_moves(pos.opponent(), pos.player()) != 0) return false;
+    const int diff = final_discs(pos.black(), pos.white());
+    return diff == g.result;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file search.hpp
+ * @brief 反復深化つきのアルファベータ探索(ネガマックス)
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "bitboard.hpp"
+#include "pattern_eval.hpp"
+#include "transposition.hpp"
+
+constexpr int disc_value = 1000; // 終局の石差1個の評価値．途中の評価より必ず大きくする
+constexpr int infinity_score = 65*disc_value;
+
+/**
+ * @brief 終局したときの評価値
+ */
+inline int final_score(const Bitboard p, const Bitboard o){
+    return final_discs(p, o)*disc_value;
+}
+
+/**
+ * @brief 途中の局面の評価値
+ * @details マスの位置の重みと着手可能数の差．隅は高く，隅の隣(C, X)は低い．
+ *          終局の石差1個(disc_value)より小さい範囲に収める．
+ */
+inline int evaluate(const Bitboard p, const Bitboard o){
+    constexpr Bitboard corner = 0x8100000000000081ull;
+    constexpr Bitboard c_square = 0x4281000000008142ull;
+    constexpr Bitboard x_square = 0x0042000000004200ull;
+    constexpr Bitboard a_square = 0x2400810000810024ull;
+    constexpr Bitboard b_square = 0x1800008181000018ull;
+    auto weight = [&](const Bitboard m){ return popcount(p & m) - popcount(o & m); };
+    const int mobility = popcount(get_moves(p, o)) - popcount(get_moves(o, p));
+    const int v = 100*weight(corner) - 20*weight(c_square) - 50*weight(x_square) + 10*weight(a_square) + 5*weight(b_square) + 8*mobility;
+    return std::clamp(v, -(disc_value - 1), disc_value - 1);
+}
+
+/**
+ * @brief 探索の結果
+ */
+struct SearchResult{
+    int move = 64;          // 最善手のマス(64ならパス)
+    int score = 0;
+    int depth = 0;          // 読み切った深さ
+    long long nodes = 0;
+    long long tt_probes = 0;
+    long long tt_hits = 0;
+    double seconds = 0.;
+};
+
+/**
+ * @brief 1手ぶんの探索をする
+ * @details 深さ1から1つずつ深くして，時間を使い切るか最大の深さまで読む．時間切れで途中になった深さの結果は捨てる．
+ *          手の並べ替えは置換表の最善手，隅，相手の着手可能数が少ない順．
+ *          idが0でないものはLazy SMPの補助スレッドで，奇数番は深さ2から始め，stopが立つまで深さを伸ばし続ける．
+ *          置換表の世代を進めるのは呼び出し側．
+ *          局面はEvalPositionのmake_move/undo_moveで進めて戻し，パターンの番号もそのとき差分で更新する．
+ *          weightsがあればパターンの評価，無ければevaluate(p, o)を使う．
+ */
+class Searcher{
+private:
+    TranspositionTable &tt;
+    const PatternWeights *weights;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> *stop;
+    int id;
+    bool aborted;
+    SearchResult result;
+    EvalPosition pos;
+    int negamax(const int depth, int alpha, int beta, const bool passed);
+    int eval();
+    int order_moves(const Bitboard p, const Bitboard o, Bitboard moves, const int tt_move, const int depth, int *list);
+    bool time_up();
+public:
+    explicit Searcher(TranspositionTable &table, std::atomic<bool> *stop_flag = nullptr, const int thread_id = 0, const PatternWeights *w = nullptr)
+        : tt(table), weights(w), stop(stop_flag), id(thread_id), aborted(false) {}
+    SearchResult search(const Bitboard p, const Bitboard o, const double seconds, const int max_depth = 60);
+};
+
+inline bool Searcher::time_up(){
+    if(aborted) return true;
+    if((result.nodes & 1023) == 0){
+        if(std::chrono::steady_clock::now() >= deadline) aborted = true;
+        if(stop && stop->load(std::memory_order_relaxed)) aborted = true;
+    }
+    return aborted;
+}
+
+/**
+ * @brief 手番側から見た途中の局面の評価値
+ * @details パターンの評価は予想した石差を1石disc_value/65で数え，終局の石差1個(disc_value)より小さい範囲に収める．
+ */
+inline int Searcher::eval(){
+    if(weights){
+        const int v = weights->evaluate(pos)*(disc_value/65)/64;
+        return std::clamp(v, -(disc_value - 1), disc_value - 1);
+    }
+    return evaluate(pos.player(), pos.opponent());
+}
+
+/**
+ * @brief 打てる手を良さそうな順にlistへ並べる
+ * @param[out] int 手の数
+ */
+inline int Searcher::order_moves(const Bitboard p, const Bitboard o, Bitboard moves, const int tt_move, const int depth, int *list){
+    constexpr Bitboard corner = 0x8100000000000081ull;
+    int n = 0;
+    int key[64];
+    for(; moves; moves &= moves - 1){
+        const int sq = first_square(moves);
+        int k = 0;
+        if(sq == tt_move) k = 1 << 20;
+        else if(depth >= 3){
+            const Bitboard f = get_flips(p, o, sq);
+            k = -popcount(get_moves(o ^ f, p | f | (Bitboard(1) << sq)))*16;
+        }
+        if((corner >> sq) & 1) k += 1 << 10;
+        int i = n++;
+        for(; i > 0 && key[i - 1] < k; i--){
+            key[i] = key[i - 1];
+            list[i] = list[i - 1];
+        }
+        key[i] = k;
+        list[i] = sq;
+    }
+    return n;
+}
+
+/**
+ * @brief ネガマックス形式のアルファベータ探索
+ * @param[in] depth 残りの深さ, passed 直前がパスか
+ * @details posの手番側から見た評価値を返す．パスは深さを減らさない．
+ */
+inline int Searcher::negamax(const int depth, int alpha, int beta, const bool passed){
+    result.nodes++;
+    if(time_up()) return 0;
+    const Bitboard p = pos.player(), o = pos.opponent();
+    const Bitboard moves = get_moves(p, o);
+    if(moves == 0){
+        if(passed) return final_score(p, o);
+        pos.make_pass();
+        const int score = -negamax(depth, -beta, -alpha, true);
+        pos.undo_move();
+        return score;
+    }
+    if(depth == 0) return eval();
+
+    const std::uint64_t key = hash_position(p, o);
+    TTData t;
+    int tt_move = 64;
+    result.tt_probes++;
+    if(tt.probe(key, t)){
+        result.tt_hits++;
+        tt_move = t.move;
+        if(t.depth >= depth){
+            if(t.bound == Bound::exact) return t.score;
+            if(t.bound == Bound::lower && t.score >= beta) return t.score;
+            if(t.bound == Bound::upper && t.score <= alpha) return t.score;
+        }
+    }
+
+    int list[64];
+    const int n = order_moves(p, o, moves, tt_move, depth, list);
+    const int alpha0 = alpha;
+    int best = -infinity_score, best_move = list[0];
+    for(int i = 0; i < n; i++){
+        const int sq = list[i];
+        pos.make_move(sq);
+        const int score = -negamax(depth - 1, -beta, -alpha, false);
+        pos.undo_move();
+        if(aborted) return 0;
+        if(score > best){
+            best = score;
+            best_move = sq;
+            if(score > alpha){
+                alpha = score;
+                if(alpha >= beta) break;
+            }
+        }
+    }
+    const Bound bound = best >= beta ? Bound::lower : (best > alpha0 ? Bound::exact : Bound::upper);
+    tt.store(key, best, depth, bound, best_move);
+    return best;
+}
+
+/**
+ * @brief 反復深化で最善手を探す
+ * @param[in] p 手番側の石, o 相手の石, seconds 持ち時間(秒), max_depth 最大の深さ
+ * @details 次の深さはふつう前の深さの数倍かかるので，持ち時間の半分を過ぎたら次の深さに入らない(主スレッドのみ)．
+ */
+inline SearchResult Searcher::search(const Bitboard p, const Bitboard o, const double seconds, const int max_depth){
+    const auto start = std::chrono::steady_clock::now();
+    deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    aborted = false;
+    result = SearchResult();
+    pos = EvalPosition(p, o, 1);
+    SearchResult best;
+    const Bitboard moves = get_moves(p, o);
+    if(moves == 0) return best;
+    best.move = first_square(moves);
+    const int empties = 64 - popcount(p | o);
+    int list[64];
+    for(int depth = 1 + (id & 1); depth <= std::min(max_depth, empties); depth++){
+        TTData t;
+        const int tt_move = tt.probe(hash_position(p, o), t) ? t.move : best.move;
+        const int n = order_moves(p, o, moves, tt_move, depth, list);
+        if(id > 0 && n > 2) std::rotate(list + 1, list + 1 + id % (n - 1), list + n); // 補助スレッドは2手目以降の順番をずらす
+        int alpha = -infinity_score, best_move = list[0];
+        for(int i = 0; i < n && !aborted; i++){
+            const int sq = list[i];
+            pos.make_move(sq);
+            const int score = -negamax(depth - 1, -infinity_score, -alpha, false);
+            pos.undo_move();
+            if(!aborted && score > alpha){
+                alpha = score;
+                best_move = sq;
+            }
+        }
+        if(aborted) break;
+        tt.store(hash_position(p, o), alpha, depth, Bound::exact, best_move);
+        best.move = best_move;
+        best.score = alpha;
+        best.depth = depth;
+        if(id == 0 && std::chrono::steady_clock::now() - start > (deadline - start) / 2) break;
+    }
+    best.nodes = result.nodes;
+    best.tt_probes = result.tt_probes;
+    best.tt_hits = result.tt_hits;
+    best.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return best;
+}
@@ -0,0 +1,321 @@
+/**
+ * @file tournament.hpp
+ * @brief 画面を使わずに多数の対局を並列に行う対戦
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bitboard.hpp"
+#include "book.hpp"
+#include "endgame.hpp"
+#include "mcts.hpp"
+#include "position.hpp"
+#include "record.hpp"
+#include "search.hpp"
+#include "transposition.hpp"
+
+/**
+ * @brief 対局者の設定
+ * @details 文字列"種類:key=value,..."から作る．種類はengine, mcts, random．
+ *          engineはdepth(最大の深さ)，time(1手の秒数)，solve(完全読みに切り替える空きマス数)，eval(パターンの重みファイル)，book(定石ファイル)，
+ *          mctsはtimeとc(探索の係数)を指定できる．
+ *          例: engine:depth=6,solve=12,eval=weights.bin   mcts:time=0.02,c=1.0
+ */
+struct PlayerSpec{
+    std::string kind = "engine";
+    int depth = 60;
+    double time = 0.05;
+    int solve = 12;
+    double c = 1.4;
+    std::string eval;
+    std::string book;
+    std::string name;
+};
+
+/**
+ * @brief 対局者の設定を読む
+ * @param[out] bool 読めたか
+ * @details 数が読めないとき，depthかtimeが正でないとき，solveかcが負のときは失敗にする．
+ */
+inline bool parse_player(const std::string &text, PlayerSpec &spec){
+    spec = PlayerSpec();
+    spec.name = text;
+    const auto colon = text.find(':');
+    spec.kind = text.substr(0, colon);
+    if(spec.kind != "engine" && spec.kind != "mcts" && spec.kind != "random") return false;
+    if(colon == std::string::npos) return true;
+    std::stringstream s(text.substr(colon + 1));
+    std::string item;
+    while(std::getline(s, item, ',')){
+        const auto eq = item.find('=');
+        if(eq == std::string::npos) return false;
+        const std::string key = item.substr(0, eq), value = item.substr(eq + 1);
+        try{
+            if(key == "depth") spec.depth = std::stoi(value);
+            else if(key == "time") spec.time = std::stod(value);
+            else if(key == "solve") spec.solve = std::stoi(value);
+            else if(key == "c") spec.c = std::stod(value);
+            else if(key == "eval" && spec.kind == "engine") spec.eval = value;
+            else if(key == "book" && spec.kind == "engine") spec.book = value;
+            else return false;
+        }
+        catch(const std::exception&){
+            return false;
+        }
+    }
+    return spec.depth > 0 && spec.time > 0. && spec.solve >= 0 && spec.c >= 0.;
+}
+
+/**
+ * @brief 1スレッドぶんの対局者
+ * @details 置換表やMCTSの領域はスレッドごとに持つので，対局中にほかのスレッドと共有するものは無い．
+ */
+class MatchPlayer{
+private:
+    PlayerSpec spec;
+    std::unique_ptr<TranspositionTable> tt;
+    std::unique_ptr<MctsPlayer> mcts;
+    std::unique_ptr<PatternWeights> weights;
+    std::unique_ptr<OpeningBook> book;
+    std::uint64_t rng;
+public:
+    MatchPlayer(const PlayerSpec &s, const std::size_t megabytes, const std::uint64_t seed);
+    void new_game(){ if(tt) tt->clear(); }
+    int choose(const Bitboard p, const Bitboard o);
+};
+
+inline MatchPlayer::MatchPlayer(const PlayerSpec &s, const std::size_t megabytes, const std::uint64_t seed)
+    : spec(s)
+    , rng(seed | 1)
+{
+    if(spec.kind == "engine"){
+        tt.reset(new TranspositionTable(megabytes));
+        if(!spec.eval.empty()){
+            weights.reset(new PatternWeights());
+            if(!weights->load(spec.eval)){
+                std::cerr << "cannot load " << spec.eval << ", using the default evaluation" << std::endl;
+                weights.reset();
+            }
+        }
+        if(!spec.book.empty()){
+            book.reset(new OpeningBook());
+            if(!book->load(spec.book)){
+                std::cerr << "cannot load " << spec.book << std::endl;
+                book.reset();
+            }
+        }
+    }
+    else if(spec.kind == "mcts") mcts.reset(new MctsPlayer(megabytes, 1, spec.c));
+}
+
+/**
+ * @brief 手を選ぶ(打てる手があるときだけ呼ぶ)
+ */
+inline int MatchPlayer::choose(const Bitboard p, const Bitboard o){
+    if(spec.kind == "engine"){
+        int move, score, depth;
+        if(book && book->probe(p, o, move, score, depth)) return move;
+        if(64 - popcount(p | o) <= spec.solve) return solve_endgame(*tt, 1, p, o).move;
+        tt->new_search();
+        Searcher searcher(*tt, nullptr, 0, weights.get());
+        return searcher.search(p, o, spec.time, spec.depth).move;
+    }
+    if(spec.kind == "mcts") return mcts->search(p, o, spec.time).move;
+    Bitboard moves = get_moves(p, o);
+    for(int k = static_cast<int>(xorshift64(rng) % popcount(moves)); k > 0; k--) moves &= moves - 1;
+    return first_square(moves);
+}
+
+/**
+ * @brief 対戦の設定
+ */
+struct MatchConfig{
+    PlayerSpec a, b;
+    int games = 1000;           // 最大の対局数(2局ずつ色を入れ替える)
+    int opening_plies = 8;      // 初期局面からランダムに打つ手数
+    int threads = 1;
+    std::size_t megabytes = 64; // 置換表とMCTSの領域の合計
+    std::uint64_t seed = 1;
+    bool sprt = false;
+    double elo0 = 0., elo1 = 5.;
+    double alpha = 0.05, beta = 0.05;
+    std::string record;         // 棋譜を追記するファイル(空なら書かない)
+};
+
+/**
+ * @brief 勝ち負けの集計とElo
+ * @details 1局の得点を勝ち1，引き分け0.5，負け0とし，平均得点sからElo差 -400 log10(1/s - 1)を求める．
+ *          信頼区間は1局の得点の分散から求めた平均得点の95%区間をEloに直したもの．
+ *          SPRTは平均得点を正規分布で近似した対数尤度比 N (s1 - s0)(2s - s0 - s1) / (2 var)．
+ */
+struct MatchStats{
+    long long wins = 0, draws = 0, losses = 0;
+    long long games() const { return wins + draws + losses; }
+    double score() const { return games() ? (wins + 0.5*draws) / games() : 0.5; }
+    double variance() const {
+        const double s = score();
+        return games() ? (wins*(1. - s)*(1. - s) + draws*(0.5 - s)*(0.5 - s) + losses*s*s) / games() : 0.;
+    }
+    static double elo(const double s){
+        const double c = std::min(std::max(s, 1e-6), 1. - 1e-6);
+        return -400.*std::log10(1./c - 1.);
+    }
+    static double expected(const double elo){ return 1. / (1. + std::pow(10., -elo/400.)); }
+    double margin() const { return games() ? 1.96*std::sqrt(variance() / games()) : 0.5; }
+    double llr(const double elo0, const double elo1) const {
+        const double var = variance();
+        if(games() == 0 || var <= 0.) return 0.;
+        const double s0 = expected(elo0), s1 = expected(elo1), s = score();
+        return games()*(s1 - s0)*(2.*s - s0 - s1) / (2.*var);
+    }
+};
+
+/**
+ * @brief 対局の番号などから乱数の種を作る
+ */
+inline std::uint64_t mix_seed(const std::uint64_t seed, const std::uint64_t n){
+    std::uint64_t state = seed*0xD1B54A32D192ED03ull + n;
+    return splitmix64(state);
+}
+
+/**
+ * @brief 1局打つ
+ * @param[in] black 黒, white 白, opening 初期局面から打つ序盤の手
+ * @param[out] record 棋譜(序盤の手を含む)
+ * @param[out] int 黒から見た最終石差
+ */
+inline int play_game(MatchPlayer &black, MatchPlayer &white, const GameRecord &opening, GameRecord &record){
+    black.new_game();
+    white.new_game();
+    record = opening;
+    Position start;
+    for(int i = 0; i < opening.n; i++) start.make_move(opening.moves[i]);
+    Bitboard p = start.player(), o = start.opponent();
+    int side = start.side();
+    bool passed = false;
+    while(true){
+        if(get_moves(p, o) == 0){
+            if(passed) break;
+            passed = true;
+            std::swap(p, o);
+            side = 3 - side;
+            continue;
+        }
+        passed = false;
+        const int sq = (side == 1 ? black : white).choose(p, o);
+        record.push(sq);
+        const Bitboard f = get_flips(p, o, sq);
+        const Bitboard next_p = o ^ f;
+        o = p | f | (Bitboard(1) << sq);
+        p = next_p;
+        side = 3 - side;
+    }
+    const int diff = side == 1 ? final_discs(p, o) : -final_discs(p, o);
+    record.result = static_cast<std::int8_t>(diff);
+    return diff;
+}
+
+/**
+ * @brief ランダムな序盤の局面
+ * @details 2局ずつ同じ序盤で色を入れ替えるので，序盤の有利不利は打ち消し合う．パスが必要になったら打つのをやめる．
+ */
+inline GameRecord random_opening(const int plies, std::uint64_t seed){
+    Position pos;
+    GameRecord opening;
+    for(int i = 0; i < plies; i++){
+        Bitboard moves = pos.moves();
+        if(moves == 0) break;
+        for(int k = static_cast<int>(xorshift64(seed) % popcount(moves)); k > 0; k--) moves &= moves - 1;
+        pos.make_move(first_square(moves));
+        opening.push(first_square(moves));
+    }
+    return opening;
+}
+
+/**
+ * @brief 対戦を行って結果を表示する
+ * @details スレッドごとに2人の対局者を作り，序盤を1つ取っては色を入れ替えて2局打つ．
+ *          2局終わるたびに集計し，SPRTの境界を越えたらほかのスレッドにも止めるよう知らせる．
+ *          棋譜のファイルを開けないときは1局も打たずに空の結果を返す．
+ */
+inline MatchStats run_match(const MatchConfig &config){
+    const auto start = std::chrono::steady_clock::now();
+    const int threads = std::max(1, config.threads);
+    const std::size_t megabytes = std::max<std::size_t>(1, config.megabytes / (2*threads));
+    const double lower = std::log(config.beta / (1. - config.alpha));
+    const double upper = std::log((1. - config.beta) / config.alpha);
+    std::atomic<int> next_pair(0);
+    std::atomic<bool> stop(false);
+    std::mutex m;
+    MatchStats stats;
+    std::string verdict;
+    std::unique_ptr<RecordWriter> writer;
+    if(!config.record.empty()){
+        writer.reset(new RecordWriter(config.record));
+        if(!writer->good()){
+            std::cerr << "cannot write " << config.record << std::endl;
+            return stats;
+        }
+    }
+    auto report = [&](){
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double s = stats.score(), d = stats.margin();
+        std::cout << "games " << stats.games() << "  +" << stats.wins << " =" << stats.draws << " -" << stats.losses
+                  << "  elo " << MatchStats::elo(s) << " [" << MatchStats::elo(s - d) << ", " << MatchStats::elo(s + d) << "]";
+        if(config.sprt) std::cout << "  llr " << stats.llr(config.elo0, config.elo1) << " (" << lower << ", " << upper << ")";
+        std::cout << "  " << stats.games() / sec << " games/sec" << std::endl;
+    };
+    auto work = [&](const int id){
+        MatchPlayer a(config.a, megabytes, mix_seed(config.seed, 2*id));
+        MatchPlayer b(config.b, megabytes, mix_seed(config.seed, 2*id + 1));
+        for(int pair; !stop.load() && (pair = next_pair.fetch_add(1)) < (config.games + 1) / 2; ){
+            const GameRecord opening = random_opening(config.opening_plies, mix_seed(config.seed, 0x10000 + pair));
+            GameRecord g0, g1;
+            const int a0 = play_game(a, b, opening, g0);   // aが黒
+            const int a1 = -play_game(b, a, opening, g1);  // aが白
+            if(writer){
+                writer->write(g0);
+                writer->write(g1);
+            }
+            std::lock_guard<std::mutex> lock(m);
+            for(const int r : {a0, a1}){
+                if(r > 0) stats.wins++;
+                else if(r == 0) stats.draws++;
+                else stats.losses++;
+            }
+            if(stats.games() % 100 == 0) report();
+            if(config.sprt && verdict.empty()){
+                const double llr = stats.llr(config.elo0, config.elo1);
+                std::stringstream v;
+                if(llr >= upper) v << "H1 accepted (elo >= " << config.elo1 << ")";
+                else if(llr <= lower) v << "H0 accepted (elo <= " << config.elo0 << ")";
+                verdict = v.str();
+                if(!verdict.empty()) stop.store(true);
+            }
+        }
+    };
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < threads; i++) helpers.emplace_back(work, i);
+    work(0);
+    for(auto&& t : helpers) t.join();
+
+    std::cout << config.a.name << " vs " << config.b.name << std::endl;
+    report();
+    if(config.sprt) std::cout << "sprt " << (verdict.empty() ? "inconclusive" : verdict) << std::endl;
+    return stats;
+}
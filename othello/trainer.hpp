@@ -0,0 +1,74 @@
+/**
+ * @file trainer.hpp
+ * @brief 棋譜からパターンの重みを学習する
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pattern_eval.hpp"
+#include "position.hpp"
+#include "record.hpp"
+
+/**
+ * @brief 学習の設定
+ */
+struct TrainConfig{
+    std::string records;    // 棋譜ファイル
+    std::string output;     // 重みファイル
+    int epochs = 10;
+    float rate = 0.005f;    // 学習率
+};
+
+/**
+ * @brief 確率的勾配降下法で重みを最小二乗に合わせる
+ * @details 棋譜の各局面(手を打つ前)について，手番側から見た最終石差を目標に，予想との差の二乗を小さくする．
+ *          1エポックごとに棋譜ファイルを先頭から読み直すので，棋譜をメモリに載せなくてよい．
+ */
+inline bool train_patterns(const TrainConfig &config){
+    const PatternSet &ps = patterns();
+    std::vector<float> w(static_cast<std::size_t>(n_phases)*ps.table_size, 0.f);
+    const int n = static_cast<int>(ps.instance_type.size());
+    std::vector<int> features(n);
+    for(int epoch = 0; epoch < config.epochs; epoch++){
+        const auto start = std::chrono::steady_clock::now();
+        RecordReader reader(config.records);
+        if(!reader.good()){
+            std::cerr << "cannot read " << config.records << std::endl;
+            return false;
+        }
+        GameRecord g;
+        double squared = 0.;
+        long long positions = 0;
+        while(reader.next(g)){
+            EvalPosition pos;
+            for(int i = 0; i < g.n; i++){
+                if(pos.moves() == 0) pos.make_pass();
+                const int target = pos.side() == 1 ? g.result : -g.result; // 色1が黒
+                float *t = w.data() + static_cast<std::size_t>(phase_of(pos.empties()))*ps.table_size;
+                float predict = t[0];
+                for(int k = 0; k < n; k++){
+                    const int index = pos.side() == 1 ? pos.instance_index(k) : ps.swap[pos.instance_index(k)];
+                    features[k] = ps.type_offset[ps.instance_type[k]] + index;
+                    predict += t[features[k]];
+                }
+                const float error = target - predict;
+                squared += error*error;
+                positions++;
+                t[0] += config.rate*error;
+                for(int k = 0; k < n; k++) t[features[k]] += config.rate*error;
+                pos.make_move(g.moves[i]);
+            }
+        }
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "epoch " << epoch + 1 << "  positions " << positions << "  rmse " << std::sqrt(squared / std::max(1LL, positions))
+                  << " discs  " << positions / std::max(sec, 1e-9) << " positions/sec" << std::endl;
+    }
+    return PatternWeights::save(config.output, w);
+}
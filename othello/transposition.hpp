@@ -0,0 +1,167 @@
+/**
+ * @file transposition.hpp
+ * @brief Zobristハッシュと置換表
+ * @author yuto-te
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "bitboard.hpp"
+
+/**
+ * @brief splitmix64
+ */
+constexpr std::uint64_t splitmix64(std::uint64_t &state){
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Zobristの乱数表
+ * @details 1マスずつ足すと1局面で最大128回の表引きになるので，手番側と相手側の石をそれぞれ8バイトに分け，
+ *          バイトの値ごとの乱数を持つ(16×256個)．1局面16回の表引きでハッシュが求まる．
+ */
+constexpr std::array< std::array<std::uint64_t, 256>, 16 > make_zobrist(){
+    std::array< std::array<std::uint64_t, 256>, 16 > table{};
+    std::uint64_t state = 0x0123456789ABCDEFull;
+    for(int i = 0; i < 16; i++){
+        for(int b = 0; b < 256; b++){
+            table[i][b] = splitmix64(state);
+        }
+    }
+    return table;
+}
+
+inline constexpr auto zobrist = make_zobrist();
+
+/**
+ * @brief 局面のハッシュ値
+ * @param[in] p 手番側の石, o 相手の石
+ * @details 石は手番側から見た形で持つので，手番の情報は要らない．
+ */
+inline std::uint64_t hash_position(const Bitboard p, const Bitboard o){
+    std::uint64_t h = 0;
+    for(int i = 0; i < 8; i++){
+        h ^= zobrist[i][(p >> (8*i)) & 0xff];
+        h ^= zobrist[8 + i][(o >> (8*i)) & 0xff];
+    }
+    return h;
+}
+
+/**
+ * @brief 置換表に入れた評価値がどちら側の境界か
+ */
+enum class Bound : std::uint8_t { none = 0, upper = 1, lower = 2, exact = 3 };
+
+/**
+ * @brief 置換表の1エントリの中身
+ * @details 64ビットに詰める．下位32ビットが評価値，次の8ビットが深さ，2ビットが境界，7ビットが最善手(64なら無し)，8ビットが世代．
+ */
+struct TTData{
+    int score = 0;
+    int depth = -1;
+    Bound bound = Bound::none;
+    int move = 64;
+    int generation = 0;
+    std::uint64_t pack() const {
+        return static_cast<std::uint32_t>(score)
+             | static_cast<std::uint64_t>(depth & 0xff) << 32
+             | static_cast<std::uint64_t>(bound) << 40
+             | static_cast<std::uint64_t>(move & 0x7f) << 42
+             | static_cast<std::uint64_t>(generation & 0xff) << 49;
+    }
+    static TTData unpack(const std::uint64_t d){
+        TTData t;
+        t.score = static_cast<std::int32_t>(static_cast<std::uint32_t>(d));
+        t.depth = static_cast<int>((d >> 32) & 0xff);
+        t.bound = static_cast<Bound>((d >> 40) & 3);
+        t.move = static_cast<int>((d >> 42) & 0x7f);
+        t.generation = static_cast<int>((d >> 49) & 0xff);
+        return t;
+    }
+};
+
+/**
+ * @brief ロックを使わない置換表
+ * @details 1エントリはkey^dataとdataの2語．別々のスレッドが同時に書いて2語が食い違っても，
+ *          読むときにkey^dataをdataで戻した値が探しているkeyと一致しなければ無かったことにするので壊れた中身は使われない．
+ *          エントリ数は2のべきで，サイズ(MB)以下で最大のものにする．
+ */
+class TranspositionTable{
+private:
+    struct Entry{
+        std::atomic<std::uint64_t> check{0};
+        std::atomic<std::uint64_t> data{0};
+    };
+    std::unique_ptr<Entry[]> table;
+    std::size_t mask;
+    int generation;
+public:
+    explicit TranspositionTable(const std::size_t megabytes = 64);
+    void clear();
+    void new_search(){ generation = (generation + 1) & 0xff; }
+    bool probe(const std::uint64_t key, TTData &t) const;
+    void store(const std::uint64_t key, const int score, const int depth, const Bound bound, const int move);
+    std::size_t size() const { return mask + 1; }
+};
+
+inline TranspositionTable::TranspositionTable(const std::size_t megabytes)
+    : generation(0)
+{
+    std::size_t n = 1;
+    while(n*2*sizeof(Entry) <= megabytes*(std::size_t(1) << 20)) n *= 2;
+    table.reset(new Entry[n]);
+    mask = n - 1;
+}
+
+inline void TranspositionTable::clear(){
+    for(std::size_t i = 0; i <= mask; i++){
+        table[i].check.store(0, std::memory_order_relaxed);
+        table[i].data.store(0, std::memory_order_relaxed);
+    }
+    generation = 0;
+}
+
+/**
+ * @brief 局面を探す
+ * @param[in] key ハッシュ値
+ * @param[out] t 見つかったエントリ
+ * @param[out] bool 見つかったか
+ */
+inline bool TranspositionTable::probe(const std::uint64_t key, TTData &t) const {
+    const Entry &e = table[key & mask];
+    const std::uint64_t d = e.data.load(std::memory_order_relaxed);
+    if((e.check.load(std::memory_order_relaxed) ^ d) != key || d == 0) return false;
+    t = TTData::unpack(d);
+    return true;
+}
+
+/**
+ * @brief 局面を書き込む
+ * @details 別の局面か前の探索のものなら上書きし，同じ局面なら深さが同じか深いときだけ上書きする．
+ */
+inline void TranspositionTable::store(const std::uint64_t key, const int score, const int depth, const Bound bound, const int move){
+    Entry &e = table[key & mask];
+    const std::uint64_t old = e.data.load(std::memory_order_relaxed);
+    if((e.check.load(std::memory_order_relaxed) ^ old) == key && old != 0){
+        const TTData t = TTData::unpack(old);
+        if(t.generation == generation && t.depth > depth) return;
+    }
+    TTData t;
+    t.score = score;
+    t.depth = depth;
+    t.bound = bound;
+    t.move = move;
+    t.generation = generation;
+    const std::uint64_t d = t.pack();
+    e.check.store(key ^ d, std::memory_order_relaxed);
+    e.data.store(d, std::memory_order_relaxed);
+}
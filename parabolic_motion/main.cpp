@@ -1,9 +1,13 @@
 /*
 放物運動を解いてみる
+RK45(Dormand-Prince)
 */
 
 #include<iostream>
 #include<cmath>
+#include<algorithm>
+
+#include "../ode/dormand_prince.hpp"
 
 // 重力加速度
 constexpr double g = 9.80665;
@@ -21,6 +25,20 @@ struct Condition
     double vy;
 };
 
+Condition operator*(const double a, const Condition &c){
+    return Condition{a*c.x, a*c.y, a*c.vx, a*c.vy};
+}
+
+Condition operator+(const Condition &c1, const Condition &c2){
+    return Condition{c1.x + c2.x, c1.y + c2.y, c1.vx + c2.vx, c1.vy + c2.vy};
+}
+
+// 刻み幅の調節に使う誤差の大きさ
+double error_norm(const Condition &err, const Condition &c0, const Condition &c1, const double atol, const double rtol){
+    return std::max({ode::error_norm(err.x, c0.x, c1.x, atol, rtol), ode::error_norm(err.y, c0.y, c1.y, atol, rtol),
+                     ode::error_norm(err.vx, c0.vx, c1.vx, atol, rtol), ode::error_norm(err.vy, c0.vy, c1.vy, atol, rtol)});
+}
+
 // initial condition
 Condition initCondition(){
     double theta = std::atan(1) * 4. * 1. / 6.;
@@ -34,19 +52,19 @@ Condition initCondition(){
     return cond;
 }
 
-// time step
-Condition step(Condition& cond){
-    cond.x += cond.vx * dt;
-    cond.y += cond.vy * dt;
-    cond.vx = cond.vx;
-    cond.vy -= g * dt;
-    return cond;
+// equation of motion
+void equationOfMotion(const Condition &cond, Condition &dcond, const double /*t*/){
+    dcond.x = cond.vx;
+    dcond.y = cond.vy;
+    dcond.vx = 0.;
+    dcond.vy = -g;
 }
 
 int main()
 {
     Condition c = initCondition();
-    double t;
+    ode::DormandPrince45<Condition, double> rk45;
+    double t = 0.;
 
     FILE *gnuplot = popen("gnuplot -persist","w");
     fprintf(gnuplot, "set size square\n");
@@ -56,8 +74,10 @@ int main()
     for(std::size_t i {}; t < tlim; ++i){
         // std::cout << t << " " << c.x << " " << c.y << std::endl;
         fprintf(gnuplot, "%lf, %lf\n", c.x, c.y);
-        c = step(c);
-        t = i * dt;
+        if(!rk45.integrate(equationOfMotion, c, t, (i + 1) * dt)){
+            std::cerr << "integration stopped at t = " << t << " (step size " << rk45.step_size() << ")" << std::endl;
+            break;
+        }
         if(c.y <= 0.){
             break;
         }